@@ -29,24 +29,91 @@ static bool too_many_loops(unsigned loops);
 void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 
-static struct list sleeping_list;
+/* Hierarchical timing wheel holding every pending timer_event.
+
+   Level L has WHEEL_SIZE slots, each covering
+   WHEEL_SIZE**L ticks, so the four levels together cover
+   WHEEL_SIZE**4 = 2**24 ticks ahead of wheel_clock.  An event is
+   filed in the lowest level whose range covers its expiry, which
+   is O(1).  Each tick expires one level-0 slot; whenever the
+   level-0 index wraps to 0 the matching slot of the next level
+   is "cascaded", that is, its events are filed again into the
+   levels below.  Every event is moved at most WHEEL_LEVELS - 1
+   times, so expiry is amortized O(1) as well.
+
+   Bit S of wheel_map[L] is set iff wheel[L][S] is nonempty. */
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_map[WHEEL_LEVELS];
+static int64_t wheel_clock;     /* Next tick to be processed. */
+
+static void wheel_insert(struct timer_event* ev);
+static void wheel_cascade(int level);
+static void run_expired_timers(void);
+static void timer_add_at(struct timer_event* ev, int64_t expires,
+  timer_func* func, void* aux);
+static int64_t timer_next_expiry(void);
+static void timer_advance(int64_t n);
+
+/* 8254 input frequency, and its count for one timer tick,
+   rounded to nearest. */
+#define PIT_HZ 1193180
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot interval the 16-bit counter can express, in
+   timer ticks. */
+#define PIT_MAX_TICKS (0xffff / PIT_TICK_COUNT)
+
+/* If false (default), the PIT interrupts TIMER_FREQ times per
+   second.  If true, the idle thread reprograms it in one-shot
+   mode to fire at the next timer deadline.  Controlled by kernel
+   command-line option "-tickless". */
+bool timer_tickless;
+
+/* Ticks covered by the armed one-shot, or 0 if the PIT is in
+   periodic mode. */
+static int64_t oneshot_ticks;
+
+static void pit_set_periodic(void);
+static void pit_set_oneshot(uint16_t count);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void timer_init(void)
 {
-  /* 8254 input frequency divided by TIMER_FREQ, rounded to
-     nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  pit_set_periodic();
+
+  intr_register_ext(0x20, timer_interrupt, "8254 Timer");
+
+  for (int level = 0; level < WHEEL_LEVELS; level++)
+    for (int slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init(&wheel[level][slot]);
+}
+
+/* Programs the PIT to interrupt TIMER_FREQ times per second. */
+static void
+pit_set_periodic(void)
+{
+  uint16_t count = PIT_TICK_COUNT;
 
   outb(0x43, 0x34); /* CW: counter 0, LSB then MSB, mode 2, binary. */
   outb(0x40, count & 0xff);
   outb(0x40, count >> 8);
+}
 
-  intr_register_ext(0x20, timer_interrupt, "8254 Timer");
-
-  list_init(&sleeping_list); // 리스트 초기화 시킴
+/* Programs the PIT to interrupt once, COUNT input clocks from
+   now. */
+static void
+pit_set_oneshot(uint16_t count)
+{
+  outb(0x43, 0x30); /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb(0x40, count & 0xff);
+  outb(0x40, count >> 8);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -94,24 +161,133 @@ timer_elapsed(int64_t then)
   return timer_ticks() - then;
 }
 
+/* Timer callback that wakes up the thread sleeping in
+   timer_sleep(). */
+static void
+timer_wakeup(void* t)
+{
+  thread_unblock(t);
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void timer_sleep(int64_t ticks)
 {
   int64_t start = timer_ticks();
-  int64_t wakeup_tick = start + ticks; // 언제 깨어날지
+  struct timer_event wakeup; // 잠든 동안 스택에 그대로 남아있음
 
   ASSERT(intr_get_level() == INTR_ON);
+  if (ticks <= 0)
+    return;
 
-  thread_current()->wakeup_tick = wakeup_tick; // 깨어날 시각 저장
   enum intr_level old_level = intr_disable();  // 인터럽트 비활성화 시킴
 
-  // 일어나야할 친구들을 오름차순으로 정렬 후에 삽입
-  list_insert_ordered(&sleeping_list, &thread_current()->elem, earlier_wake_up, NULL);
+  // 깨어날 시각에 timer_wakeup이 호출되도록 타이머 휠에 등록
+  timer_add_at(&wakeup, start + ticks, timer_wakeup, thread_current());
 
   thread_block();            // 현재 스레드 block 시킴 (깨울때까지 잠들어있도록)
   intr_set_level(old_level); // 인터럽트 원래대로 복구 시킴
 }
 
+/* Arranges for FUNC(AUX) to be called from the timer interrupt
+   handler once TICKS timer ticks have passed.  EV is owned by the
+   timer subsystem until FUNC is called or timer_cancel() returns,
+   so it must stay valid until then; FUNC may add EV again.
+
+   FUNC runs in an external interrupt context, so it must not
+   sleep.  This function may be called from an interrupt
+   handler. */
+void
+timer_add(struct timer_event* ev, timer_func* func, void* aux, int64_t ticks)
+{
+  enum intr_level old_level = intr_disable();
+  timer_add_at(ev, timer_ticks() + ticks, func, aux);
+  intr_set_level(old_level);
+}
+
+/* Cancels EV if it is still pending.  Returns true if it was
+   pending, false if it already ran.  EV must have been passed to
+   timer_add() before, or be zero-initialized. */
+bool
+timer_cancel(struct timer_event* ev)
+{
+  enum intr_level old_level = intr_disable();
+  bool pending = ev->pending;
+
+  if (pending) {
+    list_remove(&ev->elem);
+    if (list_empty(&wheel[ev->level][ev->slot]))
+      wheel_map[ev->level] &= ~(1ULL << ev->slot);
+    ev->pending = false;
+  }
+  intr_set_level(old_level);
+
+  return pending;
+}
+
+/* Files EV to run FUNC(AUX) at tick EXPIRES.
+   Interrupts must be off. */
+static void
+timer_add_at(struct timer_event* ev, int64_t expires, timer_func* func,
+  void* aux)
+{
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(func != NULL);
+
+  ev->expires = expires;
+  ev->func = func;
+  ev->aux = aux;
+  ev->pending = true;
+  wheel_insert(ev);
+}
+
+/* Puts EV into the slot of the lowest level whose range covers
+   its expiry.  Events due before wheel_clock go into the slot
+   processed next; events beyond the top level's range go into
+   its farthest slot and are refiled when it is cascaded. */
+static void
+wheel_insert(struct timer_event* ev)
+{
+  int64_t expires = ev->expires;
+  int64_t delta = expires - wheel_clock;
+  int level;
+
+  if (delta < 0)
+    expires = wheel_clock;
+  else if (delta >= 1LL << (WHEEL_BITS * WHEEL_LEVELS))
+    expires = wheel_clock + (1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (expires - wheel_clock < 1LL << (WHEEL_BITS * (level + 1)))
+      break;
+
+  ev->level = level;
+  ev->slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  list_push_back(&wheel[level][ev->slot], &ev->elem);
+  wheel_map[level] |= 1ULL << ev->slot;
+}
+
+/* Refiles the events of LEVEL's current slot into the lower
+   levels, then cascades the next level too if LEVEL has wrapped
+   around. */
+static void
+wheel_cascade(int level)
+{
+  int slot = (wheel_clock >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list* bucket = &wheel[level][slot];
+  struct list pending;
+
+  list_init(&pending);
+  while (!list_empty(bucket))
+    list_push_back(&pending, list_pop_front(bucket));
+  wheel_map[level] &= ~(1ULL << slot);
+
+  while (!list_empty(&pending))
+    wheel_insert(list_entry(list_pop_front(&pending), struct timer_event, elem));
+
+  if (slot == 0 && level + 1 < WHEEL_LEVELS)
+    wheel_cascade(level + 1);
+}
+
 /* Suspends execution for approximately MS milliseconds. */
 void timer_msleep(int64_t ms)
 {
@@ -136,21 +312,134 @@ void timer_print_stats(void)
   printf("Timer: %" PRId64 " ticks\n", timer_ticks());
 }
 
-static void check_sleeping_threads(void)
+/* Returns the tick by which the timer interrupt must next run:
+   the expiry of the first nonempty level-0 slot, or the next
+   cascade of level 1 if any higher level holds an event.
+   Returns INT64_MAX if the wheel is empty.
+   Interrupts must be off. */
+static int64_t
+timer_next_expiry(void)
 {
-  while (!list_empty(&sleeping_list))
+  int64_t next = INT64_MAX;
+  int cur = wheel_clock & WHEEL_MASK;
+  int level;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  /* Rotate so bit 0 is the slot processed next. */
+  if (wheel_map[0] != 0)
   {
-    struct list_elem *e = list_front(&sleeping_list);
-    struct thread *t = list_entry(e, struct thread, elem);
+    uint64_t rot = cur == 0 ? wheel_map[0]
+      : (wheel_map[0] >> cur) | (wheel_map[0] << (WHEEL_SIZE - cur));
+    next = wheel_clock + __builtin_ctzll(rot);
+  }
 
-    if (t->wakeup_tick <= ticks)
+  for (level = 1; level < WHEEL_LEVELS; level++)
+    if (wheel_map[level] != 0)
     {
-      list_pop_front(&sleeping_list);
-      thread_unblock(t);
+      int64_t cascade = wheel_clock + ((WHEEL_SIZE - cur) & WHEEL_MASK);
+      if (cascade < next)
+        next = cascade;
+      break;
     }
-    else
+  return next;
+}
+
+/* Called by the idle thread, with interrupts off, right before
+   it halts.  In tickless mode, replaces the periodic interrupt by
+   a one-shot one at the next timer deadline, capped at
+   PIT_MAX_TICKS (5 ticks at 100 Hz) by the 16-bit counter. */
+void
+timer_idle_enter(void)
+{
+  int64_t delta;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  delta = timer_next_expiry() - ticks;
+  if (delta > PIT_MAX_TICKS)
+    delta = PIT_MAX_TICKS;
+  if (delta <= 1)
+    return;
+
+  pit_set_oneshot(delta * PIT_TICK_COUNT);
+  oneshot_ticks = delta;
+}
+
+/* Called by the idle thread, with interrupts off, after it wakes
+   up.  If some other interrupt ended the halt before the one-shot
+   fired, catches `ticks' up by the whole ticks that have elapsed
+   and returns the PIT to periodic mode.  The partial tick is
+   lost, so each early wake-up may delay the clock by less than
+   one tick. */
+void
+timer_idle_exit(void)
+{
+  uint16_t remaining;
+  int64_t elapsed;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (oneshot_ticks == 0)
+    return;
+
+  /* Read back the status of counter 0.  If OUT is high the
+     one-shot has fired and its interrupt, still pending, will do
+     the catch-up. */
+  outb(0x43, 0xe2);
+  if (inb(0x40) & 0x80)
+    return;
+
+  outb(0x43, 0x00); /* Latch counter 0. */
+  remaining = inb(0x40);
+  remaining |= inb(0x40) << 8;
+  elapsed = (oneshot_ticks * PIT_TICK_COUNT - remaining) / PIT_TICK_COUNT;
+
+  oneshot_ticks = 0;
+  pit_set_periodic();
+  timer_advance(elapsed);
+}
+
+/* Runs the per-tick work for N ticks. */
+static void
+timer_advance(int64_t n)
+{
+  while (n-- > 0)
+  {
+    ticks++;
+    thread_tick();
+    run_expired_timers();
+  }
+}
+
+/* Advances the wheel up to the current tick, calling the
+   function of each event that has expired. */
+static void run_expired_timers(void)
+{
+  while (wheel_clock <= ticks)
+  {
+    int slot = wheel_clock & WHEEL_MASK;
+    struct list* bucket = &wheel[0][slot];
+    struct list expired;
+
+    if (slot == 0)
+      wheel_cascade(1);
+
+    /* Detach the slot first: a callback that adds its event
+       again must not land in the list being drained. */
+    list_init(&expired);
+    while (!list_empty(bucket))
+      list_push_back(&expired, list_pop_front(bucket));
+    wheel_map[0] &= ~(1ULL << slot);
+    wheel_clock++;
+
+    while (!list_empty(&expired))
     {
-      break;
+      struct timer_event *ev =
+        list_entry(list_pop_front(&expired), struct timer_event, elem);
+      ev->pending = false;
+      ev->func(ev->aux);
     }
   }
 }
@@ -159,11 +448,17 @@ static void check_sleeping_threads(void)
 static void
 timer_interrupt(struct intr_frame *args UNUSED)
 {
-  
-  ticks++;
-  thread_tick();
+  int64_t n = 1;
 
-  check_sleeping_threads();
+  /* A one-shot armed by timer_idle_enter() stands for several
+     ticks. */
+  if (oneshot_ticks != 0)
+  {
+    n = oneshot_ticks;
+    oneshot_ticks = 0;
+    pit_set_periodic();
+  }
+  timer_advance(n);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 
 // /* An open file. */
@@ -11,12 +12,23 @@
 // 	bool deny_write;            /* Has file_deny_write() been called? */
 // };
 
+/* Cache for `struct file'. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+	if (file_cache == NULL)
+		PANIC ("file_init: out of memory");
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) {
-	struct file *file = calloc (1, sizeof *file);
+	struct file *file = kmem_cache_zalloc (file_cache);
 	
 	if (inode != NULL && file != NULL) {
 		file->inode = inode;
@@ -25,7 +37,7 @@ file_open (struct inode *inode) {
 		return file;
 	} else {
 		inode_close (inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 		return NULL;
 	}
 }
@@ -56,7 +68,7 @@ file_close (struct file *file) {
 	if (file != NULL) {
 		file_allow_write (file);
 		inode_close (file->inode);
-		free (file);
+		kmem_cache_free (file_cache, file);
 	}
 }
 
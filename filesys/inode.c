@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -56,10 +57,16 @@ byte_to_sector (const struct inode *inode, off_t pos) {
  * returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Cache for `struct inode'. */
+static struct kmem_cache *inode_cache;
+
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+	if (inode_cache == NULL)
+		PANIC ("inode_init: out of memory");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -118,7 +125,7 @@ inode_open (disk_sector_t sector) {
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
+	inode = kmem_cache_alloc (inode_cache);
 	if (inode == NULL)
 		return NULL;
 
@@ -130,6 +137,7 @@ inode_open (disk_sector_t sector) {
 	inode->removed = false;
 	/* sync */
 	lock_init(&inode->inode_lock);
+	lock_set_name(&inode->inode_lock, "inode_lock");
 	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
 }
@@ -169,7 +177,7 @@ inode_close (struct inode *inode) {
 					bytes_to_sectors (inode->data.length)); 
 		}
 
-		free (inode); 
+		kmem_cache_free (inode_cache, inode);
 	}
 }
 
@@ -1,12 +1,17 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
-static unsigned loops_per_tick;
+
+/* Use one-shot timer interrupts while idle?
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
 
 void timer_init (void);
 void timer_calibrate (void);
@@ -21,5 +26,25 @@ void timer_nsleep (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Function called from the timer interrupt when a timer_event
+   expires. */
+typedef void timer_func (void *aux);
+
+/* A deferred call, kept in the timer wheel until it expires. */
+struct timer_event {
+	struct list_elem elem;      /* Element in a wheel slot. */
+	int64_t expires;            /* Tick at which FUNC is called. */
+	timer_func *func;           /* Function to call. */
+	void *aux;                  /* Argument to FUNC. */
+	bool pending;               /* In the wheel? */
+	int level, slot;            /* Wheel position while pending. */
+};
+
+void timer_add (struct timer_event *, timer_func *, void *aux, int64_t ticks);
+bool timer_cancel (struct timer_event *);
+
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void busy_wait(int64_t loops);
 #endif /* devices/timer.h */
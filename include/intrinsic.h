@@ -43,6 +43,30 @@ static __inline uint64_t read_eflags(void) {
 	return rflags;
 }
 
+__attribute__((always_inline))
+static __inline void lcr0(uint64_t val) {
+	__asm __volatile("movq %0, %%cr0" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rcr0(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr0,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rcr3(void) {
 	uint64_t val;
@@ -119,6 +143,14 @@ static __inline uint64_t rcr2(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+		uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+	__asm __volatile("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (leaf), "c" (subleaf));
+}
+
 __attribute__((always_inline))
 static __inline void write_msr(uint32_t ecx, uint64_t val) {
 	uint32_t edx, eax;
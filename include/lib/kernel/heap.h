@@ -0,0 +1,74 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+ *
+ * This is an intrusive pairing heap: like a struct list, it
+ * does not allocate memory.  Each structure that can be in a
+ * heap embeds a struct heap_elem member, and heap_entry()
+ * converts a struct heap_elem back to the structure that
+ * contains it, just like list_entry().
+ *
+ * The heap is ordered by a heap_less_func supplied to
+ * heap_init().  heap_top() returns the element that is "less"
+ * than every other, so a "less" function that returns true when
+ * A has higher priority than B makes a max-priority queue.
+ *
+ * Costs, for a heap of N elements:
+ *
+ *   heap_top()                   O(1)
+ *   heap_push()                  O(1)
+ *   heap_pop(), heap_remove()    O(log N) amortized
+ *
+ * Changing the key of an element that is in a heap breaks the
+ * heap.  Remove the element, change the key, and push it again.
+ *
+ * Elements that compare equal come out in no particular order,
+ * so callers that need FIFO order among equals should break
+ * ties with a sequence number. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* Leftmost child. */
+	struct heap_elem *next;     /* Next sibling. */
+	struct heap_elem *prev;     /* Previous sibling, or parent. */
+};
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A must come out of the
+   heap before B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap {
+	struct heap_elem *root;     /* Top element, or null. */
+	size_t size;                /* Number of elements. */
+	heap_less_func *less;       /* Ordering. */
+	void *aux;                  /* Auxiliary data for LESS. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+		- offsetof (STRUCT, MEMBER.child)))
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (const struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
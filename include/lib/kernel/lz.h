@@ -0,0 +1,32 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression.
+ *
+ * Compresses a buffer of up to 64 kB into the LZ4 block format:
+ * a series of sequences, each a run of literal bytes followed by
+ * a copy of earlier output, found through a hash table of recent
+ * 4-byte strings.  It trades ratio for speed, which suits
+ * compressing pages on their way out of memory.
+ *
+ * lz_compress() needs a work table of LZ_TABLE_SIZE entries from
+ * the caller, so that it uses no static state and little stack.
+ *
+ * lz_decompress() checks every length and offset against its
+ * buffers, so corrupt input makes it fail, not overrun. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries in the work table of lz_compress(). */
+#define LZ_TABLE_SIZE 4096
+
+/* Returned by lz_decompress() on corrupt input. */
+#define LZ_ERROR SIZE_MAX
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_cap, uint16_t *table);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_cap);
+
+#endif /* lib/kernel/lz.h */
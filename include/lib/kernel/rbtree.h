@@ -0,0 +1,77 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * This is an intrusive, ordered binary search tree kept balanced
+ * by the usual red-black rules, so that its height never exceeds
+ * 2 log2(N + 1).  Like a struct list, it does not allocate
+ * memory: each structure that can be in a tree embeds a struct
+ * rb_node member, and rb_entry() converts a struct rb_node back
+ * to the structure that contains it.
+ *
+ * The tree is ordered by an rb_less_func supplied to rb_init().
+ * Elements that compare equal are kept in insertion order, so a
+ * tree keyed by time behaves as a FIFO among equal keys.  The
+ * leftmost (least) element is cached.
+ *
+ * Costs, for a tree of N elements:
+ *
+ *   rb_first()                   O(1)
+ *   rb_insert(), rb_remove()     O(log N)
+ *   rb_next()                    O(log N), O(1) amortized
+ *   rb_floor()                   O(log N)
+ *
+ * Changing the key of an element that is in a tree breaks the
+ * tree.  Remove the element, change the key, and insert it
+ * again. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree node. */
+struct rb_node {
+	struct rb_node *parent;     /* Parent, or null for the root. */
+	struct rb_node *left;       /* Left child, or null. */
+	struct rb_node *right;      /* Right child, or null. */
+	bool red;                   /* Red or black. */
+};
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+   data AUX.  Returns true if A is less than B, or false if A is
+   greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+                           const struct rb_node *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree {
+	struct rb_node *root;       /* Root, or null if empty. */
+	struct rb_node *leftmost;   /* Least node, or null if empty. */
+	size_t size;                /* Number of nodes. */
+	rb_less_func *less;         /* Ordering. */
+	void *aux;                  /* Auxiliary data for LESS. */
+};
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+   structure that RB_NODE is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)               \
+	((STRUCT *) ((uint8_t *) &(RB_NODE)->parent     \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+void rb_insert (struct rb_tree *, struct rb_node *);
+void rb_remove (struct rb_tree *, struct rb_node *);
+
+struct rb_node *rb_first (const struct rb_tree *);
+struct rb_node *rb_next (const struct rb_node *);
+struct rb_node *rb_floor (const struct rb_tree *, const struct rb_node *key);
+
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
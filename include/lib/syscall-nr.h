@@ -36,6 +36,10 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Diagnostics. */
+	SYS_LOCKSTAT,               /* Print lock contention statistics. */
+	SYS_MEMSTAT,                /* Print kernel memory accounting. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -50,6 +50,10 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Diagnostics. */
+void lockstat (void);
+void memstat (void);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
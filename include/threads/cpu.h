@@ -0,0 +1,15 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+/* Optional CPU features, as reported by CPUID. */
+enum cpu_feature {
+	CPU_FEAT_PGE = 1 << 1,          /* Global pages. */
+	CPU_FEAT_PCID = 1 << 2,         /* Process-context identifiers. */
+};
+
+/* Features the CPU supports, a set of enum cpu_feature. */
+extern unsigned cpu_features;
+
+void cpu_init (void);
+
+#endif /* threads/cpu.h */
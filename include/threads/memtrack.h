@@ -0,0 +1,56 @@
+#ifndef THREADS_MEMTRACK_H
+#define THREADS_MEMTRACK_H
+
+#include <debug.h>
+#include <list.h>
+#include <stddef.h>
+
+/* Kernel memory accounting.
+
+   Built in with "make MEMTRACK=1", which defines MEMTRACK.  The
+   allocators then tag every live allocation with the call site
+   that made it, and keep live, peak and leak counters per call
+   site.  Without MEMTRACK, the calls below compile to nothing. */
+
+struct thread;
+
+/* Which allocator an allocation came from. */
+enum memtrack_kind {
+	MEMTRACK_MALLOC,                /* malloc(), calloc(), realloc(). */
+	MEMTRACK_SLAB,                  /* kmem_cache_alloc(). */
+	MEMTRACK_PALLOC,                /* palloc_get_multiple(). */
+};
+
+#ifdef MEMTRACK
+struct memtrack_site;
+
+/* Bookkeeping for one live allocation, kept by its allocator. */
+struct memtrack_tag {
+	struct list_elem elem;          /* Element in the live list. */
+	struct memtrack_site *site;     /* Call site that allocated it. */
+	size_t size;                    /* Bytes requested. */
+	int tid;                        /* Allocating thread, or -1 once
+	                                   that thread has exited. */
+};
+
+/* Return address of the function that calls the current one, which
+   is the allocation site when used in an allocator's entry point. */
+#define MEMTRACK_CALLER __builtin_return_address (0)
+
+void memtrack_init (void);
+void memtrack_alloc (struct memtrack_tag *, enum memtrack_kind,
+                     const void *caller, size_t size, size_t size_class);
+void memtrack_free (struct memtrack_tag *);
+void memtrack_resize (struct memtrack_tag *, size_t size);
+void memtrack_move (struct memtrack_tag *from, struct memtrack_tag *to);
+void memtrack_thread_exit (struct thread *);
+void memtrack_print_stats (void);
+#else
+#define MEMTRACK_CALLER NULL
+
+static inline void memtrack_init (void) {}
+static inline void memtrack_thread_exit (struct thread *t UNUSED) {}
+static inline void memtrack_print_stats (void) {}
+#endif
+
+#endif /* threads/memtrack.h */
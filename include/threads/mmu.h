@@ -2,6 +2,7 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
@@ -10,10 +11,14 @@
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4e_walk_size (uint64_t *pml4, const uint64_t va, int create,
+		uint64_t *size);
+uint64_t *pml4e_walk_large (uint64_t *pml4, const uint64_t va, uint64_t size);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void tlb_init (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
@@ -22,6 +27,18 @@ void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
+bool pml4_map_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw);
+void pml4_unmap_range (uint64_t *pml4, void *upage, size_t cnt,
+		bool free_frames);
+void pml4_protect_range (uint64_t *pml4, void *upage, size_t cnt, bool rw);
+size_t pml4_test_and_clear_accessed_range (uint64_t *pml4, void *upage,
+		size_t cnt, bool *accessed);
+size_t pml4_test_and_clear_dirty_range (uint64_t *pml4, void *upage,
+		size_t cnt, bool *dirty);
+size_t pml4_remap_frames (uint64_t *pml4, void *kpage, size_t cnt,
+		void **new_kpages, size_t *refs);
+
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
@@ -28,6 +28,10 @@
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
 #define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
 
+/* Bytes mapped by a PDE or PDPE with PTE_PS set. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)   /* 2 MB. */
+#define HUGE_PGSIZE (1UL << PDPESHIFT)   /* 1 GB. */
+
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
    ignored.
@@ -41,5 +45,7 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=large page leaf (PDEs, PDPEs only). */
+#define PTE_G 0x100                      /* 1=global, kept across CR3 loads. */
 
 #endif /* threads/pte.h */
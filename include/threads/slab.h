@@ -0,0 +1,28 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Object constructor.  Puts OBJ into its initial state.  It runs
+   once per object, when the slab holding the object is created,
+   not on every allocation, so objects must be freed back in their
+   constructed state. */
+typedef void kmem_ctor (void *obj);
+
+struct kmem_cache;
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_cache_shrink (struct kmem_cache *);
+
+bool kmem_owns (const void *);
+void kmem_free (void *);
+size_t kmem_reclaim (void);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
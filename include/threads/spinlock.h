@@ -0,0 +1,29 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Spin lock.
+ *
+ * Unlike struct lock, a spin lock never sleeps, so it may be
+ * taken by the scheduler itself and by interrupt handlers.  It
+ * must be held with interrupts off, so the holder cannot be
+ * preempted.  The kernel runs on one CPU, so a spin lock is never
+ * contended; the atomic exchange is what would keep other CPUs
+ * out.
+ *
+ * Like a named lock, a spin lock records its acquisitions under
+ * its name when lock profiling is on (see synch.c). */
+struct spinlock {
+	volatile uint32_t locked;   /* Nonzero while held. */
+	const char *name;           /* Name (for debugging). */
+	struct lock_stat *stat;     /* Contention statistics, or null. */
+};
+
+void spinlock_init (struct spinlock *, const char *name);
+void spin_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+bool spin_lock_held (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
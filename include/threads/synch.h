@@ -1,16 +1,20 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, highest priority first. */
+	struct lock_stat* stat;     /* Contention statistics, or null. */
 };
 
 void sema_init(struct semaphore*, unsigned value);
+void sema_set_name(struct semaphore*, const char* name);
 void sema_down(struct semaphore*);
 bool sema_try_down(struct semaphore*);
 void sema_up(struct semaphore*);
@@ -20,9 +24,12 @@ void sema_self_test(void);
 struct lock {
 	struct thread* holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct heap_elem holder_elem; /* Element in holder's held_locks. */
+	int64_t acquired_at;        /* Tick acquired, when profiling. */
 };
 
 void lock_init(struct lock*);
+void lock_set_name(struct lock*, const char* name);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
@@ -30,7 +37,7 @@ bool lock_held_by_current_thread(const struct lock*);
 
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, highest priority first. */
 };
 
 void cond_init(struct condition*);
@@ -38,8 +45,20 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+bool lock_compare_donation(const struct heap_elem* a,
+	const struct heap_elem* b, void* aux);
+void priority_update(struct thread* t, int priority);
 void refresh_priority(void);
 
+/* If true, named locks and semaphores record contention
+   statistics.  Controlled by kernel command-line option
+   "-lockstat". */
+extern bool lock_profiling;
+struct lock_stat;
+struct lock_stat* lock_stat_lookup(const char* name);
+void lock_stat_spin(struct lock_stat*, bool contended);
+void lock_print_stats(void);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -3,8 +3,10 @@
 #include "threads/synch.h"
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "threads/fixed-point.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -31,6 +33,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread niceness for the 4.4BSD scheduler. */
+#define NICE_MIN -20    /* Nicest. */
+#define NICE_DEFAULT 0  /* Default niceness. */
+#define NICE_MAX 20     /* Least nice. */
+
 /* A kernel thread or user process.
  *
  * Each thread structure is stored in its own 4 kB page.  The
@@ -112,14 +119,25 @@ struct thread {
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
 
-	/* timer를 위하여 선언*/
-	int64_t wakeup_tick;
-
 	/* donation을 위하여 선언 */
-	int original_priority;
-	struct lock* wait_on_lock;
-	struct list donations;
-	struct list_elem donation_elem;
+	int original_priority;              /* Priority before donation. */
+	struct lock* wait_on_lock;          /* Lock T is waiting for. */
+	struct heap held_locks;             /* Held locks, by top waiter. */
+	struct semaphore* wait_sema;        /* Semaphore T is waiting on. */
+	struct heap_elem waiter_elem;       /* Element in wait_sema->waiters. */
+	uint64_t wait_seq;                  /* FIFO order among equal waiters. */
+
+	/* mlfqs를 위하여 선언 */
+	int nice;                           /* Niceness, -20..20. */
+	fixed_t recent_cpu;                 /* Recent CPU usage. */
+	bool mlfqs_dirty;                   /* On mlfqs_dirty_list? */
+	struct list_elem mlfqs_elem;        /* mlfqs_dirty_list element. */
+	struct list_elem all_elem;          /* all_list element. */
+
+	/* cfs를 위하여 선언 */
+	uint64_t vruntime;                  /* Weighted run time, in ns. */
+	unsigned cfs_weight;                /* Weight while in a run queue. */
+	struct rb_node cfs_node;            /* Run queue tree node. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem; /* List element. */
@@ -147,6 +165,7 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	uintptr_t user_rsp;                 /* User rsp at syscall entry. */
 #endif
 
 	/* Owned by thread.c. */
@@ -159,6 +178,15 @@ struct thread {
 	 Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler.
+	 Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* Object caches for per-process bookkeeping.
+	 Created by thread_start(). */
+extern struct kmem_cache* child_status_cache;
+extern struct kmem_cache* fd_table_cache;
+
 void thread_init(void);
 void thread_start(void);
 
@@ -177,6 +205,11 @@ const char* thread_name(void);
 
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
+void thread_yield_to(struct thread*);
+
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func(struct thread* t, void* aux);
+void thread_foreach(thread_action_func*, void*);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
@@ -188,10 +221,7 @@ int thread_get_load_avg(void);
 
 void do_iret(struct intr_frame* tf);
 
-bool earlier_wake_up(const struct list_elem* a, const struct list_elem* b, void* aux);
-
-bool thread_compare_priority(const struct list_elem* a, const struct list_elem* b,
-	void* aux UNUSED);
 void thread_test_preemption(void);
+void thread_change_priority(struct thread* t, int priority);
 
 #endif /* threads/thread.h */
\ No newline at end of file
@@ -1,13 +1,32 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <bitmap.h>
+#include <stddef.h>
 #include "vm/vm.h"
 struct page;
+struct thread;
+struct zswap_entry;
 enum vm_type;
 
+/* No swap slot. */
+#define SLOT_NONE BITMAP_ERROR
+
+/* Slots in a cluster: pages cleaned together are written to one
+ * run of this many slots, and are read back in together. */
+#define SWAP_CLUSTER 8
+
 struct anon_page {
+	size_t slot;            /* Swap slot, or SLOT_NONE. */
+	struct zswap_entry *zentry; /* Compressed copy, or null. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_clean (struct page *pages[], size_t cnt);
+bool anon_write_slot (struct page *page, struct thread *owner,
+		const void *kva);
+void anon_readahead (struct page *page);
+bool anon_in_swap (const struct page *page);
+void anon_read_swap (const struct page *page, void *kva);
 
 #endif
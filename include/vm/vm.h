@@ -1,6 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
+#include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -24,6 +27,12 @@ enum vm_type {
 	VM_MARKER_END = (1 << 31),
 };
 
+/* Marks the stack area, which grows down on faults. */
+#define VM_STACK VM_MARKER_0
+
+/* Largest size the stack may grow to. */
+#define STACK_MAX (1 << 20)
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
@@ -33,6 +42,7 @@ enum vm_type {
 
 struct page_operations;
 struct thread;
+struct vma;
 
 #define VM_TYPE(type) ((type) & 7)
 
@@ -46,6 +56,9 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct rb_node node;   /* Element in spt->pages, by VA. */
+	struct vma *vma;       /* Area the page belongs to. */
+	bool writable;
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +76,11 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct thread *owner;           /* Thread whose pml4 maps PAGE. */
+	struct list_elem elem;          /* Element in the frame table. */
+	struct list_elem laundry_elem;  /* Element in the laundry. */
+	bool pinned;                    /* Kept from eviction and cleaning. */
+	bool laundry;                   /* Waiting for the cleaner? */
 };
 
 /* The function table for page operations.
@@ -82,9 +100,14 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * The address space is described by areas (struct vma, see
+ * vm/vma.c), and a struct page exists only for pages that have
+ * been touched, so that an untouched mapping costs O(1) however
+ * large it is. */
 struct supplemental_page_table {
+	struct rb_tree vmas;            /* Areas, by start address. */
+	struct rb_tree pages;           /* Touched pages, by address. */
+	struct vma *last_vma;           /* Area found last, or null. */
 };
 
 #include "threads/thread.h"
@@ -96,6 +119,13 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+void spt_remove_area (struct supplemental_page_table *spt, struct vma *vma);
+
+/* Object caches for struct page and struct frame, created by
+ * vm_init().  vm_dealloc_page()'s free() hands pages back to
+ * page_cache. */
+extern struct kmem_cache *page_cache;
+extern struct kmem_cache *frame_cache;
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -105,6 +135,16 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
+bool vm_alloc_area (enum vm_type type, void *upage, size_t page_cnt,
+		bool writable, struct file *file, off_t ofs, size_t read_bytes);
+bool vm_addr_is_valid (const void *va);
+bool vm_addr_is_writable (const void *va);
+void vm_release_frame (struct page *page);
+bool vm_prefetch_page (struct page *page);
+void *vm_reclaim_clean_frame (void);
+bool vm_migrate_begin (void);
+bool vm_migrate_frames (const void *window, size_t cnt, void *const dst[]);
+void vm_migrate_end (void);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
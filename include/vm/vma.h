@@ -0,0 +1,50 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+/* A virtual memory area: a run of pages that share their type,
+ * permissions and backing.  The supplemental page table keeps one
+ * per mapping, so that a large mapping costs one struct vma until
+ * its pages are touched. */
+struct vma {
+	struct rb_node node;            /* Element in spt->vmas, by START. */
+	uint8_t *start;                 /* First page. */
+	uint8_t *end;                   /* End of the last page. */
+	enum vm_type type;              /* What its pages become, with markers. */
+	bool writable;
+
+	/* The first READ_BYTES bytes of the area come from FILE at
+	 * OFFSET, and the rest are zeros.  FILE is the area's own
+	 * handle, closed with the area. */
+	struct file *file;
+	off_t offset;
+	size_t read_bytes;
+
+	/* Called after a page has been loaded as above. */
+	vm_initializer *init;
+	void *aux;
+};
+
+void vma_init (void);
+bool vma_less (const struct rb_node *, const struct rb_node *, void *);
+
+struct vma *vma_create (struct supplemental_page_table *, void *start,
+		size_t page_cnt, enum vm_type, bool writable);
+struct vma *vma_clone (struct supplemental_page_table *,
+		const struct vma *);
+void vma_destroy (struct supplemental_page_table *, struct vma *);
+
+struct vma *vma_find (struct supplemental_page_table *, const void *va);
+bool vma_is_free (struct supplemental_page_table *, const void *start,
+		size_t page_cnt);
+bool vma_extend_down (struct supplemental_page_table *, struct vma *,
+		void *start);
+bool vma_load_page (const struct vma *, const void *va, void *kva);
+bool vma_page_is_zero (const struct vma *, const void *va);
+
+#endif /* vm/vma.h */
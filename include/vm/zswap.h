@@ -0,0 +1,20 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+
+struct page;
+struct thread;
+struct zswap_entry;
+
+/* Largest share of the user pool, in percent, that compressed
+ * pages may take up.  0 turns the cache off. */
+extern unsigned zswap_percent;
+
+void zswap_init (void);
+bool zswap_enabled (void);
+bool zswap_store (struct page *, struct thread *owner, const void *kva);
+bool zswap_load (struct page *, void *kva);
+bool zswap_copy (const struct page *, void *kva);
+void zswap_invalidate (struct page *);
+
+#endif /* vm/zswap.h */
@@ -0,0 +1,164 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a heap-ordered tree of any shape.  Each node
+   keeps its children in a doubly linked list through `next' and
+   `prev'; the leftmost child's `prev' points to the parent
+   instead, so any node can be cut out of the tree in O(1).
+
+   Two trees are melded by making the root that loses the
+   comparison the leftmost child of the other.  Removing the root
+   leaves a list of subtrees, which are melded back in two
+   passes: pairwise left to right, then the results right to
+   left.  The two-pass merge is what gives the O(log N) amortized
+   bound. */
+
+static struct heap_elem *meld (struct heap *,
+		struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS given auxiliary
+   data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->size = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+	h->size++;
+}
+
+/* Returns the top element of H, that is, the one that is less
+   than all the others, or a null pointer if H is empty. */
+struct heap_elem *
+heap_top (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->root;
+}
+
+/* Removes and returns the top element of H, which must not be
+   empty. */
+struct heap_elem *
+heap_pop (struct heap *h) {
+	struct heap_elem *top;
+
+	ASSERT (h != NULL);
+	ASSERT (h->root != NULL);
+
+	top = h->root;
+	h->root = merge_pairs (h, top->child);
+	h->size--;
+	top->child = top->next = top->prev = NULL;
+	return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	struct heap_elem *sub;
+
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+	ASSERT (h->size > 0);
+
+	if (e == h->root) {
+		heap_pop (h);
+		return;
+	}
+
+	/* Cut E's subtree out of its parent's list of children. */
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+
+	/* Meld E's children back in. */
+	sub = merge_pairs (h, e->child);
+	if (sub != NULL)
+		h->root = meld (h, h->root, sub);
+	h->size--;
+	e->child = e->next = e->prev = NULL;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->root == NULL;
+}
+
+/* Melds the trees rooted at A and B, neither of which may have
+   siblings, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (h->less (b, a, h->aux)) {
+		struct heap_elem *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	/* B becomes the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->next = a->prev = NULL;
+	return a;
+}
+
+/* Melds the list of sibling trees starting at FIRST into one tree
+   and returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* First pass: meld adjacent pairs left to right, stacking the
+	   results on PAIRS through their `next' links. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			b->next = b->prev = NULL;
+			a = meld (h, a, b);
+		}
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Second pass: meld the stacked results right to left. */
+	while (pairs != NULL) {
+		struct heap_elem *next = pairs->next;
+
+		pairs->next = NULL;
+		root = root != NULL ? meld (h, root, pairs) : pairs;
+		pairs = next;
+	}
+	return root;
+}
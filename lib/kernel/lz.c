@@ -0,0 +1,206 @@
+#include "lz.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../debug.h"
+
+/* Each sequence starts with a token byte.  Its high nibble is the
+   number of literals and its low nibble the match length less
+   MIN_MATCH; a nibble of 15 means that more length follows, in
+   bytes that are added on up to and including the first byte
+   that is not 255.  Then come the literals, then the match offset
+   as 2 bytes, little-endian, then the rest of the match length.
+   The last sequence has literals only. */
+
+#define MIN_MATCH 4             /* Shortest match worth a sequence. */
+#define LAST_LITERALS 5         /* Bytes at the end always literal. */
+#define MF_LIMIT 12             /* No match starts closer to the end. */
+#define MAX_OFFSET 65535        /* Farthest back a match may reach. */
+
+/* LZ_TABLE_SIZE is 2**HASH_BITS. */
+#define HASH_BITS 12
+
+static bool put_length (uint8_t **op, uint8_t *op_end, size_t len);
+
+/* Reads 4 bytes at P, at any alignment. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	uint32_t v;
+
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Hashes the 4-byte string V into the work table. */
+static inline uint32_t
+hash (uint32_t v) {
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Writes the token and literals of a sequence of LIT_CNT literals
+   at LIT followed by a match of MATCH_LEN bytes at OFFSET, or of
+   just the literals if MATCH_LEN is 0, at *OP, and advances *OP.
+   Returns false if that would pass OP_END. */
+static bool
+put_sequence (uint8_t **op, uint8_t *op_end, const uint8_t *lit,
+		size_t lit_cnt, size_t offset, size_t match_len) {
+	size_t ml = match_len > 0 ? match_len - MIN_MATCH : 0;
+	uint8_t *token = *op;
+
+	if (*op >= op_end)
+		return false;
+	*token = (lit_cnt < 15 ? lit_cnt : 15) << 4 | (ml < 15 ? ml : 15);
+	(*op)++;
+
+	if (lit_cnt >= 15 && !put_length (op, op_end, lit_cnt - 15))
+		return false;
+	if (lit_cnt > (size_t) (op_end - *op))
+		return false;
+	memcpy (*op, lit, lit_cnt);
+	*op += lit_cnt;
+
+	if (match_len == 0)
+		return true;
+	if (op_end - *op < 2)
+		return false;
+	(*op)[0] = offset & 0xff;
+	(*op)[1] = offset >> 8;
+	*op += 2;
+	return ml < 15 || put_length (op, op_end, ml - 15);
+}
+
+/* Writes the extra length LEN at *OP and advances *OP.  Returns
+   false if that would pass OP_END. */
+static bool
+put_length (uint8_t **op, uint8_t *op_end, size_t len) {
+	for (;;) {
+		if (*op >= op_end)
+			return false;
+		if (len < 255) {
+			*(*op)++ = len;
+			return true;
+		}
+		*(*op)++ = 255;
+		len -= 255;
+	}
+}
+
+/* Compresses the SRC_SIZE bytes at SRC, which must be at most
+   64 kB, into DST, which has room for DST_CAP bytes, using TABLE,
+   of LZ_TABLE_SIZE entries, as scratch space.  Returns the size
+   of the compressed data, or 0 if it does not fit in DST_CAP. */
+size_t
+lz_compress (const void *src_, size_t src_size, void *dst_, size_t dst_cap,
+		uint16_t *table) {
+	const uint8_t *src = src_;
+	const uint8_t *end = src + src_size;
+	const uint8_t *ip = src, *anchor = src;
+	uint8_t *op = dst_, *op_end = op + dst_cap;
+
+	ASSERT (src_size <= MAX_OFFSET + 1);
+	ASSERT (table != NULL);
+
+	memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+	if (src_size >= MF_LIMIT) {
+		const uint8_t *ip_limit = end - MF_LIMIT;
+		const uint8_t *match_limit = end - LAST_LITERALS;
+
+		while (ip <= ip_limit) {
+			uint32_t h = hash (read32 (ip));
+			const uint8_t *ref = src + table[h];
+			const uint8_t *mp, *mr;
+
+			table[h] = ip - src;
+			if (ref >= ip || read32 (ref) != read32 (ip)) {
+				ip++;
+				continue;
+			}
+
+			/* Extend the match backward over pending literals,
+			   then forward. */
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			mp = ip + MIN_MATCH;
+			mr = ref + MIN_MATCH;
+			while (mp < match_limit && *mp == *mr) {
+				mp++;
+				mr++;
+			}
+
+			if (!put_sequence (&op, op_end, anchor, ip - anchor, ip - ref,
+						mp - ip))
+				return 0;
+			ip = anchor = mp;
+		}
+	}
+
+	if (!put_sequence (&op, op_end, anchor, end - anchor, 0, 0))
+		return 0;
+	return op - (uint8_t *) dst_;
+}
+
+/* Reads the extra length at *IP, before IP_END, adds it to *LEN,
+   and advances *IP.  Returns false if it runs past IP_END. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *ip_end, size_t *len) {
+	uint8_t b;
+
+	do {
+		if (*ip >= ip_end)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC into DST, which has room
+   for DST_CAP bytes.  Returns the size of the output, or LZ_ERROR
+   if SRC is corrupt or its output does not fit. */
+size_t
+lz_decompress (const void *src_, size_t src_size, void *dst_,
+		size_t dst_cap) {
+	const uint8_t *ip = src_, *ip_end = ip + src_size;
+	uint8_t *dst = dst_, *op = dst, *op_end = dst + dst_cap;
+
+	while (ip < ip_end) {
+		unsigned token = *ip++;
+		size_t lit_cnt = token >> 4;
+		size_t match_len = token & 15;
+		size_t offset;
+		const uint8_t *ref;
+
+		if (lit_cnt == 15 && !get_length (&ip, ip_end, &lit_cnt))
+			return LZ_ERROR;
+		if (lit_cnt > (size_t) (ip_end - ip)
+				|| lit_cnt > (size_t) (op_end - op))
+			return LZ_ERROR;
+		memcpy (op, ip, lit_cnt);
+		op += lit_cnt;
+		ip += lit_cnt;
+
+		/* The last sequence ends after its literals. */
+		if (ip == ip_end)
+			break;
+
+		if (ip_end - ip < 2)
+			return LZ_ERROR;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - dst))
+			return LZ_ERROR;
+		if (match_len == 15 && !get_length (&ip, ip_end, &match_len))
+			return LZ_ERROR;
+		match_len += MIN_MATCH;
+		if (match_len > (size_t) (op_end - op))
+			return LZ_ERROR;
+
+		/* The match may overlap its own output, so copy it a byte
+		   at a time. */
+		ref = op - offset;
+		while (match_len-- > 0)
+			*op++ = *ref++;
+	}
+	return op - dst;
+}
@@ -0,0 +1,327 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* The algorithms are those of CLRS, chapter 13, except that
+   leaves are null pointers instead of a shared sentinel node.
+   A null node counts as black. */
+
+#define is_red(NODE) ((NODE) != NULL && (NODE)->red)
+
+static void rotate_left (struct rb_tree *, struct rb_node *);
+static void rotate_right (struct rb_tree *, struct rb_node *);
+static void replace_child (struct rb_tree *, struct rb_node *parent,
+		struct rb_node *old, struct rb_node *new);
+static void insert_fixup (struct rb_tree *, struct rb_node *);
+static void remove_fixup (struct rb_tree *, struct rb_node *,
+		struct rb_node *parent);
+
+/* Initializes T as an empty tree ordered by LESS given auxiliary
+   data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = t->leftmost = NULL;
+	t->size = 0;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Inserts N into T, after any nodes that compare equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_node *n) {
+	struct rb_node **link = &t->root;
+	struct rb_node *parent = NULL;
+	bool leftmost = true;
+
+	ASSERT (t != NULL);
+	ASSERT (n != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (t->less (n, parent, t->aux))
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+
+	n->parent = parent;
+	n->left = n->right = NULL;
+	n->red = true;
+	*link = n;
+	if (leftmost)
+		t->leftmost = n;
+	t->size++;
+
+	insert_fixup (t, n);
+}
+
+/* Removes N, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_node *n) {
+	struct rb_node *child, *parent;
+	bool removed_red;
+
+	ASSERT (t != NULL);
+	ASSERT (n != NULL);
+	ASSERT (t->size > 0);
+
+	if (n == t->leftmost)
+		t->leftmost = rb_next (n);
+
+	if (n->left == NULL || n->right == NULL) {
+		/* N has at most one child, which takes its place. */
+		child = n->left != NULL ? n->left : n->right;
+		parent = n->parent;
+		removed_red = n->red;
+		replace_child (t, parent, n, child);
+		if (child != NULL)
+			child->parent = parent;
+	} else {
+		/* N's successor S, which has no left child, takes N's
+		   place and color; S's right child takes S's place. */
+		struct rb_node *s = n->right;
+
+		while (s->left != NULL)
+			s = s->left;
+		child = s->right;
+		removed_red = s->red;
+
+		if (s->parent == n)
+			parent = s;
+		else {
+			parent = s->parent;
+			parent->left = child;
+			if (child != NULL)
+				child->parent = parent;
+			s->right = n->right;
+			s->right->parent = s;
+		}
+		s->left = n->left;
+		s->left->parent = s;
+		s->red = n->red;
+		replace_child (t, n->parent, n, s);
+		s->parent = n->parent;
+	}
+
+	t->size--;
+	if (!removed_red)
+		remove_fixup (t, child, parent);
+	n->parent = n->left = n->right = NULL;
+}
+
+/* Returns the least node in T, or a null pointer if T is
+   empty. */
+struct rb_node *
+rb_first (const struct rb_tree *t) {
+	ASSERT (t != NULL);
+	return t->leftmost;
+}
+
+/* Returns the node that follows N in its tree, or a null pointer
+   if N is the greatest. */
+struct rb_node *
+rb_next (const struct rb_node *n) {
+	ASSERT (n != NULL);
+
+	if (n->right != NULL) {
+		n = n->right;
+		while (n->left != NULL)
+			n = n->left;
+		return (struct rb_node *) n;
+	}
+	while (n->parent != NULL && n == n->parent->right)
+		n = n->parent;
+	return n->parent;
+}
+
+/* Returns the last node in T that is not greater than KEY, which
+   need not be in T, or a null pointer if every node is greater.
+   Useful for finding the interval that contains a point in a tree
+   of intervals ordered by their start. */
+struct rb_node *
+rb_floor (const struct rb_tree *t, const struct rb_node *key) {
+	struct rb_node *n, *floor = NULL;
+
+	ASSERT (t != NULL);
+	ASSERT (key != NULL);
+
+	n = t->root;
+	while (n != NULL)
+		if (t->less (key, n, t->aux))
+			n = n->left;
+		else {
+			floor = n;
+			n = n->right;
+		}
+	return floor;
+}
+
+/* Returns the number of nodes in T. */
+size_t
+rb_size (const struct rb_tree *t) {
+	ASSERT (t != NULL);
+	return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t) {
+	ASSERT (t != NULL);
+	return t->root == NULL;
+}
+
+/* Makes NEW the child of PARENT that OLD was, or the root of T if
+   PARENT is null.  Does not touch NEW->parent. */
+static void
+replace_child (struct rb_tree *t, struct rb_node *parent,
+		struct rb_node *old, struct rb_node *new) {
+	if (parent == NULL)
+		t->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates the subtree rooted at X to the left. */
+static void
+rotate_left (struct rb_tree *t, struct rb_node *x) {
+	struct rb_node *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	replace_child (t, x->parent, x, y);
+	y->parent = x->parent;
+	y->left = x;
+	x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right. */
+static void
+rotate_right (struct rb_tree *t, struct rb_node *x) {
+	struct rb_node *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	replace_child (t, x->parent, x, y);
+	y->parent = x->parent;
+	y->right = x;
+	x->parent = y;
+}
+
+/* Restores the red-black properties after red node N has been
+   inserted into T. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_node *n) {
+	while (is_red (n->parent)) {
+		struct rb_node *p = n->parent;
+		struct rb_node *g = p->parent;
+
+		if (p == g->left) {
+			struct rb_node *u = g->right;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				n = g;
+				continue;
+			}
+			if (n == p->right) {
+				rotate_left (t, p);
+				n = p;
+				p = n->parent;
+			}
+			p->red = false;
+			g->red = true;
+			rotate_right (t, g);
+		} else {
+			struct rb_node *u = g->left;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				n = g;
+				continue;
+			}
+			if (n == p->left) {
+				rotate_right (t, p);
+				n = p;
+				p = n->parent;
+			}
+			p->red = false;
+			g->red = true;
+			rotate_left (t, g);
+		}
+	}
+	t->root->red = false;
+}
+
+/* Restores the red-black properties after a black node has been
+   removed from T.  X, which may be null, is the node that took its
+   place, and PARENT is X's parent. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_node *x, struct rb_node *parent) {
+	while (x != t->root && !is_red (x)) {
+		if (x == parent->left) {
+			struct rb_node *w = parent->right;
+
+			if (is_red (w)) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (t, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (t, parent);
+				x = t->root;
+			}
+		} else {
+			struct rb_node *w = parent->left;
+
+			if (is_red (w)) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (t, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (t, parent);
+				x = t->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
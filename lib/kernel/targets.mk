@@ -2,4 +2,7 @@ lib/kernel_SRC  = lib/kernel/debug.c	# Debug helpers.
 lib/kernel_SRC += lib/kernel/list.c	# Doubly-linked lists.
 lib/kernel_SRC += lib/kernel/bitmap.c	# Bitmaps.
 lib/kernel_SRC += lib/kernel/hash.c	# Hash tables.
+lib/kernel_SRC += lib/kernel/heap.c	# Priority queues.
+lib/kernel_SRC += lib/kernel/rbtree.c	# Red-black trees.
+lib/kernel_SRC += lib/kernel/lz.c	# LZ77 compression.
 lib/kernel_SRC += lib/kernel/console.c	# printf(), putchar().
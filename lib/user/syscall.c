@@ -194,3 +194,13 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+void
+lockstat (void) {
+	syscall0 (SYS_LOCKSTAT);
+}
+
+void
+memstat (void) {
+	syscall0 (SYS_MEMSTAT);
+}
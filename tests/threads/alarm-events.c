@@ -0,0 +1,132 @@
+/* Tests timer_add() and timer_cancel() directly.  Checks that
+   events expire on the exact tick asked for from each of the
+   lower three levels of the timer wheel, that a canceled event
+   never runs, and that an event may add itself again from its
+   own function. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+/* Number of times the repeating event runs, and the ticks
+   between runs, enough to file each run in wheel level 1. */
+#define REPEAT_CNT 4
+#define REPEAT_TICKS 70
+
+/* A timer event and what its function saw. */
+struct probe
+  {
+    struct timer_event ev;
+    int64_t due;                /* Tick it should run at. */
+    int64_t ran[REPEAT_CNT];    /* Ticks it ran at. */
+    int runs;                   /* Number of times it ran. */
+  };
+
+/* Upped by each event that will not run again. */
+static struct semaphore done;
+
+static void
+probe_run (void *p_)
+{
+  struct probe *p = p_;
+
+  if (p->runs < REPEAT_CNT)
+    p->ran[p->runs] = timer_ticks ();
+  p->runs++;
+  sema_up (&done);
+}
+
+static void
+repeat_run (void *p_)
+{
+  struct probe *p = p_;
+
+  p->ran[p->runs++] = timer_ticks ();
+  if (p->runs < REPEAT_CNT)
+    timer_add (&p->ev, repeat_run, p, REPEAT_TICKS);
+  else
+    sema_up (&done);
+}
+
+/* Adds P to run FUNC after TICKS ticks.  Interrupts must be off,
+   so that P->due matches the tick timer_add() starts from. */
+static void
+probe_add (struct probe *p, timer_func *func, int64_t ticks)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  p->due = timer_ticks () + ticks;
+  p->runs = 0;
+  timer_add (&p->ev, func, p, ticks);
+}
+
+/* Fails unless P ran once, on time. */
+static void
+check_ran (const char *name, const struct probe *p)
+{
+  if (p->runs != 1)
+    fail ("%s ran %d times", name, p->runs);
+  if (p->ran[0] != p->due)
+    fail ("%s ran at tick %lld, not %lld", name, p->ran[0], p->due);
+}
+
+void
+test_alarm_events (void)
+{
+  static struct probe levels[4];
+  static const int64_t delays[4] = {3, 70, 300, 4200};
+  struct probe a, b, c, r;
+  enum intr_level old_level;
+  int i;
+
+  sema_init (&done, 0);
+
+  /* 3 ticks is filed in level 0, 70 and 300 in level 1, and 4200
+     in level 2, so the later ones only run if they are cascaded
+     down correctly. */
+  msg ("adding events for levels 0, 1 and 2");
+  old_level = intr_disable ();
+  for (i = 0; i < 4; i++)
+    probe_add (&levels[i], probe_run, delays[i]);
+  intr_set_level (old_level);
+  for (i = 0; i < 4; i++)
+    sema_down (&done);
+  for (i = 0; i < 4; i++)
+    {
+      char name[32];
+      snprintf (name, sizeof name, "event after %lld ticks", delays[i]);
+      check_ran (name, &levels[i]);
+    }
+  msg ("every event ran on time");
+
+  msg ("canceling pending events");
+  old_level = intr_disable ();
+  probe_add (&a, probe_run, 20);
+  probe_add (&b, probe_run, 100);
+  probe_add (&c, probe_run, 40);
+  intr_set_level (old_level);
+  if (!timer_cancel (&a.ev) || !timer_cancel (&b.ev))
+    fail ("pending event was not canceled");
+  sema_down (&done);
+  check_ran ("uncanceled event", &c);
+  timer_sleep (b.due - timer_ticks () + 10);
+  if (a.runs != 0 || b.runs != 0)
+    fail ("canceled event ran");
+  if (timer_cancel (&a.ev) || timer_cancel (&c.ev))
+    fail ("timer_cancel() returned true for an event not pending");
+  msg ("canceled events did not run");
+
+  msg ("event adding itself again");
+  old_level = intr_disable ();
+  probe_add (&r, repeat_run, REPEAT_TICKS);
+  intr_set_level (old_level);
+  sema_down (&done);
+  for (i = 0; i < REPEAT_CNT; i++)
+    if (r.ran[i] != r.due + i * REPEAT_TICKS)
+      fail ("run %d at tick %lld, not %lld",
+            i, r.ran[i], r.due + i * REPEAT_TICKS);
+  msg ("event ran %d times on time", REPEAT_CNT);
+
+  pass ();
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-events) begin
+(alarm-events) adding events for levels 0, 1 and 2
+(alarm-events) every event ran on time
+(alarm-events) canceling pending events
+(alarm-events) canceled events did not run
+(alarm-events) event adding itself again
+(alarm-events) event ran 4 times on time
+(alarm-events) PASS
+(alarm-events) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::cfs;
+
+check_cfs_fair ([0, 0], 50);
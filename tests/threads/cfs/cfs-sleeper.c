@@ -0,0 +1,136 @@
+/* Checks that a thread waking from a long sleep under the
+   fair-share scheduler is neither starved nor allowed to
+   monopolize the CPU.
+
+   Two threads spin for 20 seconds.  A third sleeps through the
+   first 10, while the spinners' vruntime runs 5 seconds ahead of
+   its own, and then spins for the last 10.  It should run within
+   a few ticks of waking up, and then receive about a third of the
+   CPU like the others, instead of running alone until its
+   vruntime catches up. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks from the start until the sleeper wakes, and from then
+   until everyone stops. */
+#define SLEEP_TICKS (10 * TIMER_FREQ)
+#define WINDOW_TICKS (10 * TIMER_FREQ)
+
+/* Ticks after waking within which the sleeper must run, and the
+   most it may receive of the first EARLY_TICKS after waking, of
+   which its fair share is a third. */
+#define WAKE_LATENCY 10
+#define EARLY_TICKS 100
+#define EARLY_MAX 60
+
+/* Most by which any thread's ticks in the window may differ from
+   a third of it. */
+#define MAX_DIFF 50
+
+struct thread_info
+  {
+    int64_t wake_time;          /* Start of the window. */
+    int64_t end_time;           /* End of the window. */
+    int64_t first_tick;         /* First tick run in the window. */
+    int tick_count;             /* Ticks run in the window. */
+    int early_count;            /* Ticks run in the first EARLY_TICKS. */
+    struct semaphore done;
+  };
+
+static void spin (struct thread_info *);
+static void spinner_thread (void *);
+static void sleeper_thread (void *);
+
+void
+test_cfs_sleeper (void)
+{
+  struct thread_info info[3];
+  int64_t wake_time;
+  int i;
+
+  ASSERT (thread_cfs);
+
+  thread_set_nice (-20);
+
+  wake_time = timer_ticks () + SLEEP_TICKS;
+  for (i = 0; i < 3; i++)
+    {
+      info[i].wake_time = wake_time;
+      info[i].end_time = wake_time + WINDOW_TICKS;
+      info[i].first_tick = -1;
+      info[i].tick_count = 0;
+      info[i].early_count = 0;
+      sema_init (&info[i].done, 0);
+    }
+
+  msg ("Starting 2 spinners and 1 sleeper, please wait...");
+  thread_create ("spinner 0", PRI_DEFAULT, spinner_thread, &info[0]);
+  thread_create ("spinner 1", PRI_DEFAULT, spinner_thread, &info[1]);
+  thread_create ("sleeper", PRI_DEFAULT, sleeper_thread, &info[2]);
+  for (i = 0; i < 3; i++)
+    sema_down (&info[i].done);
+
+  if (info[2].first_tick < 0
+      || info[2].first_tick - wake_time > WAKE_LATENCY)
+    fail ("sleeper first ran %lld ticks after waking",
+          info[2].first_tick - wake_time);
+  msg ("Sleeper ran soon after waking.");
+
+  if (info[2].early_count > EARLY_MAX)
+    fail ("sleeper received %d of the first %d ticks after waking",
+          info[2].early_count, EARLY_TICKS);
+  msg ("Sleeper did not monopolize the CPU after waking.");
+
+  for (i = 0; i < 3; i++)
+    {
+      int diff = info[i].tick_count - WINDOW_TICKS / 3;
+      if (diff < -MAX_DIFF || diff > MAX_DIFF)
+        fail ("%s received %d of %d ticks", i < 2 ? "spinner" : "sleeper",
+              info[i].tick_count, WINDOW_TICKS);
+    }
+  msg ("Each thread received about a third of the CPU.");
+  pass ();
+}
+
+/* Spins until TI's window ends, counting the ticks it runs
+   within it. */
+static void
+spin (struct thread_info *ti)
+{
+  int64_t last_time = -1;
+  int64_t cur_time;
+
+  while ((cur_time = timer_ticks ()) < ti->end_time)
+    {
+      if (cur_time != last_time && cur_time >= ti->wake_time)
+        {
+          if (ti->first_tick < 0)
+            ti->first_tick = cur_time;
+          ti->tick_count++;
+          if (cur_time < ti->wake_time + EARLY_TICKS)
+            ti->early_count++;
+        }
+      last_time = cur_time;
+    }
+  sema_up (&ti->done);
+}
+
+static void
+spinner_thread (void *ti_)
+{
+  spin (ti_);
+}
+
+static void
+sleeper_thread (void *ti_)
+{
+  struct thread_info *ti = ti_;
+
+  timer_sleep (ti->wake_time - timer_ticks ());
+  spin (ti);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cfs-sleeper) begin
+(cfs-sleeper) Starting 2 spinners and 1 sleeper, please wait...
+(cfs-sleeper) Sleeper ran soon after waking.
+(cfs-sleeper) Sleeper did not monopolize the CPU after waking.
+(cfs-sleeper) Each thread received about a third of the CPU.
+(cfs-sleeper) PASS
+(cfs-sleeper) end
+EOF
+pass;
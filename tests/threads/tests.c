@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-events", test_alarm_events},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -38,6 +39,14 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"cfs-fair-2", test_cfs_fair_2},
+    {"cfs-nice-2", test_cfs_nice_2},
+    {"cfs-nice-10", test_cfs_nice_10},
+    {"cfs-sleeper", test_cfs_sleeper},
+#ifdef VM
+    {"palloc-compact", test_palloc_compact},
+    {"lz-roundtrip", test_lz_roundtrip},
+#endif
   };
 
 static const char *test_name;
@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_events;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -32,6 +33,14 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_cfs_fair_2;
+extern test_func test_cfs_nice_2;
+extern test_func test_cfs_nice_10;
+extern test_func test_cfs_sleeper;
+#ifdef VM
+extern test_func test_palloc_compact;
+extern test_func test_lz_roundtrip;
+#endif
 
 void msg (const char *, ...);
 void fail (const char *, ...);
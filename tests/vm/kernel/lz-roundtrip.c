@@ -0,0 +1,108 @@
+/* Compresses pages of different kinds with lz_compress() and
+   checks that lz_decompress() gives back the same bytes, then
+   feeds lz_decompress() a match that overlaps its own output and
+   a few corrupt inputs, which it must reject with LZ_ERROR. */
+
+#include <lz.h>
+#include <random.h>
+#include <stdint.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/vaddr.h"
+
+static uint8_t src[PGSIZE];
+static uint8_t out[PGSIZE];
+static uint8_t dst[2 * PGSIZE];
+static uint16_t table[LZ_TABLE_SIZE];
+
+/* Compresses SRC into DST, with room for DST_CAP bytes, and
+   decompresses it back, checking that the result matches.
+   Returns the compressed size. */
+static size_t
+round_trip (const char *name, size_t dst_cap)
+{
+  size_t size = lz_compress (src, PGSIZE, dst, dst_cap, table);
+
+  if (size == 0)
+    fail ("%s: does not fit in %zu bytes", name, dst_cap);
+  memset (out, 0xcc, PGSIZE);
+  if (lz_decompress (dst, size, out, PGSIZE) != PGSIZE)
+    fail ("%s: decompressed size differs", name);
+  if (memcmp (src, out, PGSIZE))
+    fail ("%s: decompressed data differs", name);
+  return size;
+}
+
+/* Checks that lz_decompress() rejects the SIZE bytes at IN. */
+static void
+reject (const char *name, const void *in, size_t size, size_t out_cap)
+{
+  if (lz_decompress (in, size, out, out_cap) != LZ_ERROR)
+    fail ("%s: accepted", name);
+}
+
+void
+test_lz_roundtrip (void)
+{
+  static const char text[] = "The quick brown fox jumps over the lazy dog. ";
+  size_t size;
+  size_t i;
+
+  msg ("all-zero page");
+  memset (src, 0, PGSIZE);
+  size = round_trip ("all-zero page", PGSIZE);
+  if (size > 64)
+    fail ("all-zero page: compressed to %zu bytes", size);
+
+  msg ("random page");
+  random_init (0x1234);
+  random_bytes (src, PGSIZE);
+  if (lz_compress (src, PGSIZE, dst, PGSIZE / 2, table) != 0)
+    fail ("random page: compressed to half a page");
+  size = round_trip ("random page", sizeof dst);
+  if (size <= PGSIZE)
+    fail ("random page: compressed to %zu bytes", size);
+
+  msg ("repetitive page");
+  for (i = 0; i < PGSIZE; i++)
+    src[i] = text[i % (sizeof text - 1)];
+  size = round_trip ("repetitive page", PGSIZE);
+  if (size > PGSIZE / 8)
+    fail ("repetitive page: compressed to %zu bytes", size);
+
+  /* Two literals, then a match of 4 + 15 + 100 bytes at offset 2,
+     then one last literal. */
+  msg ("overlapping match");
+  {
+    static const uint8_t in[] = {0x2f, 'x', 'y', 2, 0, 100, 0x10, 'z'};
+    size_t len = 2 + 4 + 15 + 100 + 1;
+
+    if (lz_decompress (in, sizeof in, out, PGSIZE) != len)
+      fail ("overlapping match: decompressed size differs");
+    for (i = 0; i < len - 1; i++)
+      if (out[i] != (i % 2 ? 'y' : 'x'))
+        fail ("overlapping match: byte %zu differs", i);
+    if (out[len - 1] != 'z')
+      fail ("overlapping match: last literal differs");
+  }
+
+  msg ("corrupt input");
+  {
+    static const uint8_t zero_offset[] = {0x10, 'a', 0, 0, 0x10, 'b'};
+    static const uint8_t far_offset[] = {0x10, 'a', 2, 0, 0x10, 'b'};
+    static const uint8_t long_literals[] = {0xf0, 255, 'a', 'b'};
+    static const uint8_t cut_offset[] = {0x10, 'a', 1};
+
+    reject ("zero offset", zero_offset, sizeof zero_offset, PGSIZE);
+    reject ("offset before start", far_offset, sizeof far_offset, PGSIZE);
+    reject ("literals past input", long_literals, sizeof long_literals,
+            PGSIZE);
+    reject ("truncated offset", cut_offset, sizeof cut_offset, PGSIZE);
+
+    memset (src, 0, PGSIZE);
+    size = lz_compress (src, PGSIZE, dst, PGSIZE, table);
+    reject ("output past end", dst, size, PGSIZE - 1);
+  }
+
+  pass ();
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lz-roundtrip) begin
+(lz-roundtrip) all-zero page
+(lz-roundtrip) random page
+(lz-roundtrip) repetitive page
+(lz-roundtrip) overlapping match
+(lz-roundtrip) corrupt input
+(lz-roundtrip) PASS
+(lz-roundtrip) end
+EOF
+pass;
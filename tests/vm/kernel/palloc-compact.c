@@ -0,0 +1,120 @@
+/* Fills the user pool with the frames of anonymous pages, then
+   frees every frame at an odd page number, so that no two free
+   user pages are adjacent.  A request for contiguous user pages
+   can then be served only by compaction, which must move frames
+   out of the way without losing their contents and keep the frame
+   table pointing at where they went. */
+
+#include <stdint.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Where the test maps its pages. */
+#define AREA ((uint8_t *) 0x10000000)
+
+/* # of contiguous pages asked for. */
+#define BLOCK_CNT 4
+
+static uint64_t
+pattern (size_t i)
+{
+  return 0x5a5a5a5a00000000ull | i;
+}
+
+/* Returns the page that holds the Ith page of the area. */
+static struct page *
+area_page (size_t i)
+{
+  return spt_find_page (&thread_current ()->spt, AREA + i * PGSIZE);
+}
+
+void
+test_palloc_compact (void)
+{
+  struct thread *t = thread_current ();
+  uint64_t *pml4;
+  size_t page_cnt = palloc_user_page_cnt ();
+  size_t claimed, kept = 0;
+  uint8_t *block;
+  size_t i;
+
+  t->pml4 = pml4_create ();
+  if (t->pml4 == NULL)
+    fail ("pml4_create failed");
+  supplemental_page_table_init (&t->spt);
+  pml4_activate (t->pml4);
+  if (!vm_alloc_area (VM_ANON, AREA, page_cnt, true, NULL, 0, 0))
+    fail ("vm_alloc_area failed");
+
+  msg ("fill user pool");
+  for (claimed = 0; claimed < page_cnt; claimed++)
+    {
+      uint8_t *va = AREA + claimed * PGSIZE;
+      void *probe = palloc_get_page (PAL_USER);
+
+      /* Stop short of eviction, which would free user pages. */
+      if (probe == NULL)
+        break;
+      palloc_free_page (probe);
+      if (!vm_claim_page (va))
+        fail ("vm_claim_page failed at page %zu", claimed);
+      *(uint64_t *) va = pattern (claimed);
+      *(uint64_t *) (va + PGSIZE - sizeof (uint64_t)) = ~pattern (claimed);
+    }
+  if (claimed < 2 * BLOCK_CNT)
+    fail ("only %zu user pages", claimed);
+
+  msg ("fragment user pool");
+  for (i = 0; i < claimed; i++)
+    {
+      struct page *page = area_page (i);
+
+      if (pg_no (page->frame->kva) % 2 == 1)
+        spt_remove_page (&t->spt, page);
+      else
+        kept++;
+    }
+  if (kept == 0 || kept == claimed)
+    fail ("kept %zu of %zu pages", kept, claimed);
+
+  msg ("allocate %d contiguous user pages", BLOCK_CNT);
+  block = palloc_get_multiple (PAL_USER, BLOCK_CNT);
+  if (block == NULL)
+    fail ("palloc_get_multiple failed");
+  memset (block, 0xcc, BLOCK_CNT * PGSIZE);
+
+  msg ("check pages");
+  for (i = 0; i < claimed; i++)
+    {
+      uint8_t *va = AREA + i * PGSIZE;
+      struct page *page = area_page (i);
+      uint8_t *kva;
+
+      if (page == NULL)
+        continue;
+      kva = page->frame->kva;
+      if (kva >= block && kva < block + BLOCK_CNT * PGSIZE)
+        fail ("page %zu: frame still in the allocated block", i);
+      if (pml4_get_page (t->pml4, va) != kva)
+        fail ("page %zu: mapped to %p, frame at %p",
+              i, pml4_get_page (t->pml4, va), kva);
+      if (*(uint64_t *) va != pattern (i)
+          || *(uint64_t *) (va + PGSIZE - sizeof (uint64_t)) != ~pattern (i))
+        fail ("page %zu: contents lost", i);
+      if (*(uint64_t *) kva != pattern (i))
+        fail ("page %zu: frame contents differ", i);
+    }
+
+  palloc_free_multiple (block, BLOCK_CNT);
+  supplemental_page_table_kill (&t->spt);
+  pml4 = t->pml4;
+  t->pml4 = NULL;
+  pml4_activate (NULL);
+  pml4_destroy (pml4);
+  pass ();
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-compact) begin
+(palloc-compact) fill user pool
+(palloc-compact) fragment user pool
+(palloc-compact) allocate 4 contiguous user pages
+(palloc-compact) check pages
+(palloc-compact) PASS
+(palloc-compact) end
+EOF
+pass;
@@ -0,0 +1,103 @@
+/* Checks that anonymous pages that are only read share the zero
+ * page, and that writing one of them, whether from user code,
+ * through a system call, or after a fork, gives it a frame of its
+ * own without the write showing up anywhere else. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_WORDS (PAGE_SIZE / sizeof (uint32_t))
+#define BIG_PAGE_COUNT 256
+#define BIG_WORDS (BIG_PAGE_COUNT * PAGE_WORDS)
+#define BIG_INDEX 12345
+#define BIG_VALUE 0xdeadbeef
+
+static uint32_t big[BIG_WORDS];
+static char buf[2 * PAGE_SIZE];
+static char other[2 * PAGE_SIZE];
+
+/* Fails unless the SIZE bytes at P are all zero. */
+static void
+check_zero (const char *name, const void *p, size_t size)
+{
+	const char *c = p;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (c[i] != 0)
+			fail ("byte %zu of %s is %02hhx (should be 0)", i, name, c[i]);
+}
+
+/* Fails unless BIG holds zeros but for BIG_VALUE at BIG_INDEX. */
+static void
+check_big (void)
+{
+	size_t i;
+
+	for (i = 0; i < BIG_WORDS; i++)
+		if (big[i] != (i == BIG_INDEX ? BIG_VALUE : 0))
+			fail ("word %zu of big has value %08x", i, big[i]);
+}
+
+void
+test_main (void)
+{
+	size_t ofs = PAGE_SIZE - 100;
+	int handle;
+	pid_t child;
+
+	msg ("read big array");
+	check_zero ("big", big, sizeof big);
+	/* The first and last pages of BIG may hold other variables too,
+	 * so look at pages well inside it. */
+	CHECK (get_phys_addr (&big[PAGE_WORDS]) != 0
+			&& get_phys_addr (&big[PAGE_WORDS])
+			== get_phys_addr (&big[BIG_WORDS - 2 * PAGE_WORDS]),
+			"check that read pages share a frame");
+
+	msg ("write one element");
+	big[BIG_INDEX] = BIG_VALUE;
+	check_big ();
+	CHECK (get_phys_addr (&big[BIG_INDEX]) != get_phys_addr (&big[PAGE_WORDS]),
+			"check that the written page has its own frame");
+
+	/* BUF's pages are mapped to the zero page, so the kernel's
+	 * writes to them fault and must be given frames. */
+	msg ("read into zero-mapped buffer");
+	check_zero ("buf", buf, sizeof buf);
+	CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+	CHECK (read (handle, buf + ofs, sizeof sample - 1)
+			== (int) (sizeof sample - 1), "read \"sample.txt\"");
+	close (handle);
+	if (memcmp (buf + ofs, sample, sizeof sample - 1))
+		fail ("read of \"sample.txt\" reported bad data");
+	check_zero ("buf before data", buf, ofs);
+	check_zero ("buf after data", buf + ofs + sizeof sample - 1,
+			sizeof buf - ofs - (sizeof sample - 1));
+	check_big ();
+
+	msg ("fork after zero read");
+	check_zero ("other", other, sizeof other);
+	child = fork ("child");
+	if (child == 0) {
+		check_zero ("other in child", other, sizeof other);
+		other[PAGE_SIZE] = 'c';
+		check_zero ("other in child after write", other, PAGE_SIZE);
+		check_zero ("other in child after write", other + PAGE_SIZE + 1,
+				PAGE_SIZE - 1);
+		if (other[PAGE_SIZE] != 'c')
+			fail ("write in child was lost");
+		check_big ();
+		exit (81);
+	}
+	CHECK (wait (child) == 81, "wait for child");
+	check_zero ("other in parent", other, sizeof other);
+	other[0] = 'p';
+	check_zero ("other in parent after write", other + 1, sizeof other - 1);
+	check_big ();
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lazy-zero) begin
+(lazy-zero) read big array
+(lazy-zero) check that read pages share a frame
+(lazy-zero) write one element
+(lazy-zero) check that the written page has its own frame
+(lazy-zero) read into zero-mapped buffer
+(lazy-zero) open "sample.txt"
+(lazy-zero) read "sample.txt"
+(lazy-zero) fork after zero read
+(lazy-zero) wait for child
+(lazy-zero) end
+EOF
+pass;
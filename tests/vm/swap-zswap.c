@@ -0,0 +1,68 @@
+/* Checks that anonymous pages are swapped out and swapped in
+ * properly when the compressed swap cache is on.  For this test,
+ * Pintos memory size is 10MB and the kernel runs with -zswap=50.
+ * Writes every word of more pages than fit in memory, so that
+ * eviction goes through the cache: one page in three holds
+ * pseudo-random words, which do not compress and fall through to
+ * the swap disk, one in three is all zeros, and the rest repeat a
+ * single word.  Then checks every word of every page. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define ONE_MB (1 << 20) // 1MB
+#define CHUNK_SIZE (20*ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+#define PAGE_WORDS (PAGE_SIZE / sizeof (uint32_t))
+
+static uint32_t big_chunks[CHUNK_SIZE / sizeof (uint32_t)];
+
+/* Returns the word that belongs at index I of page PAGE. */
+static uint32_t
+word (size_t page, size_t i)
+{
+	uint32_t x;
+
+	switch (page % 3) {
+	case 0:
+		x = (page * PAGE_WORDS + i) * 2654435761u + 1;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	case 1:
+		return 0;
+	default:
+		return page;
+	}
+}
+
+void
+test_main (void)
+{
+	size_t page, i;
+
+	for (page = 0; page < PAGE_COUNT; page++) {
+		uint32_t *mem = big_chunks + page * PAGE_WORDS;
+
+		if (!(page % 512))
+			msg ("write over page %zu", page);
+		for (i = 0; i < PAGE_WORDS; i++)
+			mem[i] = word (page, i);
+	}
+
+	for (page = 0; page < PAGE_COUNT; page++) {
+		uint32_t *mem = big_chunks + page * PAGE_WORDS;
+
+		for (i = 0; i < PAGE_WORDS; i++)
+			if (mem[i] != word (page, i))
+				fail ("data is inconsistent in page %zu", page);
+		if (!(page % 512))
+			msg ("check consistency in page %zu", page);
+	}
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-zswap) begin
+(swap-zswap) write over page 0
+(swap-zswap) write over page 512
+(swap-zswap) write over page 1024
+(swap-zswap) write over page 1536
+(swap-zswap) write over page 2048
+(swap-zswap) write over page 2560
+(swap-zswap) write over page 3072
+(swap-zswap) write over page 3584
+(swap-zswap) write over page 4096
+(swap-zswap) write over page 4608
+(swap-zswap) check consistency in page 0
+(swap-zswap) check consistency in page 512
+(swap-zswap) check consistency in page 1024
+(swap-zswap) check consistency in page 1536
+(swap-zswap) check consistency in page 2048
+(swap-zswap) check consistency in page 2560
+(swap-zswap) check consistency in page 3072
+(swap-zswap) check consistency in page 3584
+(swap-zswap) check consistency in page 4096
+(swap-zswap) check consistency in page 4608
+(swap-zswap) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+#include "threads/cpu.h"
+#include <stdint.h>
+#include "intrinsic.h"
+
+/* CPU identification: which optional features the CPU has, for
+ * the code that uses them if present, such as global pages and
+ * PCIDs in mmu.c. */
+
+/* Features the CPU supports, a set of enum cpu_feature. */
+unsigned cpu_features;
+
+/* Records which optional features the CPU supports. */
+static void
+detect_features (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+	if (edx & (1u << 13))
+		cpu_features |= CPU_FEAT_PGE;
+	if (ecx & (1u << 17))
+		cpu_features |= CPU_FEAT_PCID;
+}
+
+/* Identifies the CPU. */
+void
+cpu_init (void) {
+	detect_features ();
+}
@@ -13,13 +13,16 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtrack.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -31,6 +34,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -53,6 +57,9 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -memstats: Print memory allocator statistics at power off? */
+static bool memory_stats;
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
@@ -80,14 +87,17 @@ main (void) {
 	argv = read_command_line ();
 	argv = parse_options (argv);
 
-	/* Initialize ourselves as a thread so we can use locks,
-	   then enable console locking. */
+	/* Probe the CPU's features, then initialize ourselves as a
+	   thread so we can use locks, then enable console locking. */
+	cpu_init ();
 	thread_init ();
 	console_init ();
 
 	/* Initialize memory system. */
+	memtrack_init ();
 	mem_end = palloc_init ();
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
 
 #ifdef USERPROG
@@ -103,6 +113,7 @@ main (void) {
 #ifdef USERPROG
 	exception_init ();
 	syscall_init ();
+	process_cache_init ();
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
@@ -143,31 +154,64 @@ bss_init (void) {
 	memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the direct map can map physical address PA with
+ * a single SIZE-byte page: PA and its virtual address must both
+ * be SIZE-aligned, the page must end by MEM_END, and it must not
+ * overlap the kernel text [TEXT_START, TEXT_END), which has to be
+ * read-only on its own. */
+static bool
+large_page_fits (uint64_t pa, uint64_t size, uint64_t mem_end,
+		uint64_t text_start, uint64_t text_end) {
+	return pa % size == 0 && (uint64_t) ptov (pa) % size == 0
+		&& pa + size <= mem_end
+		&& (pa + size <= text_start || pa >= text_end);
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ * Memory is mapped with 2 MB pages, falling back to 4 kB pages
+ * only around the kernel text and at the unaligned end of memory.
+ * 1 GB pages are not used: KERN_BASE is 64 MB past a 1 GB
+ * boundary, so no virtual address in the direct map is 1 GB
+ * aligned together with its physical address.  The mappings are
+ * global where the CPU supports it. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
+	uint64_t size;
 	int perm;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = vtop (&start);
+	uint64_t text_end = vtop (&_end_kernel_text);
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; pa += size) {
 		uint64_t va = (uint64_t) ptov(pa);
 
 		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		if (large_page_fits (pa, LARGE_PGSIZE, mem_end,
+					text_start, text_end))
+			size = LARGE_PGSIZE;
+		else
+			size = PGSIZE;
+
+		if (cpu_features & CPU_FEAT_PGE)
+			perm |= PTE_G;
+		if (size != PGSIZE)
+			perm |= PTE_PS;
+		else if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
-		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
+		if ((pte = pml4e_walk_large (pml4, va, size)) != NULL)
 			*pte = pa | perm;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+	tlb_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -224,16 +268,31 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-cfs"))
+			thread_cfs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-lockstat"))
+			lock_profiling = true;
+		else if (!strcmp (name, "-memstats"))
+			memory_stats = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-zswap"))
+			zswap_percent = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
 	}
 
+	if (thread_mlfqs && thread_cfs)
+		PANIC ("-mlfqs and -cfs are mutually exclusive");
+
 	return argv;
 }
 
@@ -331,8 +390,15 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -cfs               Use fair-share (virtual runtime) scheduler.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -lockstat          Profile contention on named locks.\n"
+			"  -memstats          Print memory allocator statistics.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -zswap=PCT         Compress swap into PCT%% of user memory.\n"
 #endif
 			);
 	power_off ();
@@ -359,6 +425,12 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	lock_print_stats ();
+	if (memory_stats) {
+		palloc_print_stats ();
+		kmem_print_stats ();
+	}
+	memtrack_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
@@ -5,7 +5,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memtrack.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -33,7 +35,14 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   realloc() keeps a block where it is when its size class still
+   fits the new size, and grows or shrinks a big block in place
+   when the pages after it are free.
+
+   With MEMTRACK, each block starts with a struct memtrack_tag and
+   the caller gets the bytes that follow it. */
 
 /* Descriptor. */
 struct desc {
@@ -64,6 +73,11 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_at (size_t, const void *caller);
+static void *block_alloc (size_t);
+static void block_free (void *);
+static size_t block_size (void *);
+static bool block_resize (void *, size_t);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -77,6 +91,7 @@ malloc_init (void) {
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+		lock_set_name (&d->lock, "malloc_desc");
 	}
 }
 
@@ -84,6 +99,31 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	return malloc_at (size, MEMTRACK_CALLER);
+}
+
+/* Does malloc() on behalf of the function at CALLER. */
+static void *
+malloc_at (size_t size, const void *caller UNUSED) {
+#ifdef MEMTRACK
+	struct memtrack_tag *tag;
+
+	if (size == 0)
+		return NULL;
+	tag = block_alloc (sizeof *tag + size);
+	if (tag == NULL)
+		return NULL;
+	memtrack_alloc (tag, MEMTRACK_MALLOC, caller, size, block_size (tag));
+	return tag + 1;
+#else
+	return block_alloc (size);
+#endif
+}
+
+/* Returns a new block of at least SIZE bytes, or a null pointer if
+   memory is not available. */
+static void *
+block_alloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -158,7 +198,7 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_at (size, MEMTRACK_CALLER);
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -175,21 +215,78 @@ block_size (void *block) {
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes the caller may use in P, a pointer
+   returned by malloc(), calloc(), or realloc(), which is at least
+   the number requested.  Returns 0 for a null pointer. */
+size_t
+malloc_usable_size (void *p) {
+	if (p == NULL)
+		return 0;
+#ifdef MEMTRACK
+	return block_size ((struct memtrack_tag *) p - 1)
+		- sizeof (struct memtrack_tag);
+#else
+	return block_size (p);
+#endif
+}
+
+/* Tries to make BLOCK hold SIZE bytes without moving it.  A small
+   block stays if SIZE still belongs in its size class.  A big
+   block stays big, unless SIZE would fit a small block, and gains
+   or loses pages at its end.  Returns true if successful. */
+static bool
+block_resize (void *block, size_t size) {
+	struct arena *a = block_to_arena (block);
+	struct desc *d = a->desc;
+	size_t page_cnt;
+
+	if (d != NULL)
+		return size <= d->block_size
+			&& (d == descs || size > d[-1].block_size);
+
+	if (size <= descs[desc_cnt - 1].block_size)
+		return false;
+	page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+	if (page_cnt != a->free_cnt
+			&& !palloc_resize_multiple (a, a->free_cnt, page_cnt))
+		return false;
+	a->free_cnt = page_cnt;
+	return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   OLD_BLOCK is returned unmoved if block_resize() can make it fit
+   NEW_SIZE. */
 void *
 realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
 		free (old_block);
 		return NULL;
+	} else if (old_block == NULL) {
+		return malloc_at (new_size, MEMTRACK_CALLER);
 	} else {
-		void *new_block = malloc (new_size);
-		if (old_block != NULL && new_block != NULL) {
-			size_t old_size = block_size (old_block);
+		void *new_block;
+#ifdef MEMTRACK
+		struct memtrack_tag *tag = (struct memtrack_tag *) old_block - 1;
+
+		if (new_size <= SIZE_MAX - sizeof *tag
+				&& block_resize (tag, sizeof *tag + new_size)) {
+			memtrack_resize (tag, new_size);
+			return old_block;
+		}
+#else
+		if (block_resize (old_block, new_size))
+			return old_block;
+#endif
+
+		new_block = malloc_at (new_size, MEMTRACK_CALLER);
+		if (new_block != NULL) {
+			size_t old_size = malloc_usable_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
 			free (old_block);
@@ -199,45 +296,60 @@ realloc (void *old_block, size_t new_size) {
 }
 
 /* Frees block P, which must have been previously allocated with
-   malloc(), calloc(), or realloc(). */
+   malloc(), calloc(), or realloc(), or with kmem_cache_alloc(). */
 void
 free (void *p) {
-	if (p != NULL) {
-		struct block *b = p;
-		struct arena *a = block_to_arena (b);
-		struct desc *d = a->desc;
+	if (p != NULL && kmem_owns (p)) {
+		/* It's an object from a slab cache. */
+		kmem_free (p);
+	} else if (p != NULL) {
+#ifdef MEMTRACK
+		struct memtrack_tag *tag = (struct memtrack_tag *) p - 1;
+
+		memtrack_free (tag);
+		p = tag;
+#endif
+		block_free (p);
+	}
+}
 
-		if (d != NULL) {
-			/* It's a normal block.  We handle it here. */
+/* Returns block P to its descriptor, or its pages to the page
+   allocator if it is a big block. */
+static void
+block_free (void *p) {
+	struct block *b = p;
+	struct arena *a = block_to_arena (b);
+	struct desc *d = a->desc;
+
+	if (d != NULL) {
+		/* It's a normal block.  We handle it here. */
 
 #ifndef NDEBUG
-			/* Clear the block to help detect use-after-free bugs. */
-			memset (b, 0xcc, d->block_size);
+		/* Clear the block to help detect use-after-free bugs. */
+		memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
+		lock_acquire (&d->lock);
 
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
+		/* Add block to free list. */
+		list_push_front (&d->free_list, &b->free_elem);
 
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
+		/* If the arena is now entirely unused, free it. */
+		if (++a->free_cnt >= d->blocks_per_arena) {
+			size_t i;
 
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			ASSERT (a->free_cnt == d->blocks_per_arena);
+			for (i = 0; i < d->blocks_per_arena; i++) {
+				struct block *b = arena_to_block (a, i);
+				list_remove (&b->free_elem);
 			}
-
-			lock_release (&d->lock);
-		} else {
-			/* It's a big block.  Free its pages. */
-			palloc_free_multiple (a, a->free_cnt);
-			return;
+			palloc_free_page (a);
 		}
+
+		lock_release (&d->lock);
+	} else {
+		/* It's a big block.  Free its pages. */
+		palloc_free_multiple (a, a->free_cnt);
 	}
 }
 
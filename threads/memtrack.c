@@ -0,0 +1,261 @@
+#include "threads/memtrack.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+
+#ifdef MEMTRACK
+/* Kernel memory accounting.
+
+   Each allocator embeds a struct memtrack_tag in, or next to,
+   every allocation it hands out: malloc() puts it in front of the
+   block, slab caches after the object, and palloc keeps one per
+   page in a table beside its bitmap.  memtrack_alloc() files the
+   tag under the allocation's call site, found by hashing the
+   return address of the allocator's entry point, and on the list
+   of live allocations.
+
+   A site whose objects outlive the thread that allocated them is
+   a leak suspect.  When a thread exits, its remaining allocations
+   are counted as orphaned under their sites until they are freed.
+   Objects that are meant to be handed to other threads, such as
+   malloc() arenas or slabs, show up as orphans too; per-process
+   objects like file descriptor tables should not.
+
+   Everything here is guarded by a spin lock taken with interrupts
+   off, since pages are freed from the scheduler. */
+
+/* Hash table of call sites.  Must be a power of 2. */
+#define SITE_CNT 256
+
+/* Statistics for one call site. */
+struct memtrack_site {
+	const void *caller;             /* Return address, null if unused. */
+	enum memtrack_kind kind;        /* Allocator. */
+	size_t size_class;              /* Largest size class used. */
+	unsigned long long allocs;      /* # of allocations. */
+	unsigned long long frees;       /* # of frees. */
+	size_t live_bytes;              /* Bytes allocated and not freed. */
+	size_t peak_bytes;              /* Largest LIVE_BYTES so far. */
+	size_t orphans;                 /* Live objects whose thread died. */
+	size_t orphan_bytes;            /* Bytes in those objects. */
+};
+
+static struct memtrack_site sites[SITE_CNT];
+static size_t site_cnt;
+static size_t dropped;              /* Allocations with no site slot. */
+
+/* Live allocations, across all allocators. */
+static struct list live_list;
+static size_t live_bytes, peak_bytes;
+
+static struct spinlock memtrack_lock;
+
+static const char *kind_names[] = { "malloc", "slab", "palloc" };
+
+/* Initializes memory accounting.  Must be called before any
+   allocation. */
+void
+memtrack_init (void) {
+	list_init (&live_list);
+	spinlock_init (&memtrack_lock, "memtrack");
+}
+
+/* Returns the site for CALLER and KIND, creating it if needed, or
+   a null pointer if the table is full. */
+static struct memtrack_site *
+site_lookup (const void *caller, enum memtrack_kind kind) {
+	size_t h = ((uintptr_t) caller >> 2) * 2654435761u + kind;
+
+	for (size_t i = 0; i < SITE_CNT; i++) {
+		struct memtrack_site *s = &sites[(h + i) & (SITE_CNT - 1)];
+
+		if (s->caller == caller && s->kind == kind)
+			return s;
+		if (s->caller == NULL) {
+			if (site_cnt >= SITE_CNT * 3 / 4)
+				return NULL;
+			s->caller = caller;
+			s->kind = kind;
+			site_cnt++;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/* Records that the function at CALLER got SIZE bytes, from the
+   SIZE_CLASS bucket of allocator KIND, and fills in TAG, which the
+   allocator keeps with the allocation until memtrack_free(). */
+void
+memtrack_alloc (struct memtrack_tag *tag, enum memtrack_kind kind,
+		const void *caller, size_t size, size_t size_class) {
+	enum intr_level old_level = intr_disable ();
+	struct memtrack_site *s;
+
+	spin_lock (&memtrack_lock);
+	s = site_lookup (caller, kind);
+	tag->site = s;
+	tag->size = size;
+	tag->tid = thread_tid ();
+	if (s != NULL) {
+		s->allocs++;
+		s->live_bytes += size;
+		if (s->live_bytes > s->peak_bytes)
+			s->peak_bytes = s->live_bytes;
+		if (size_class > s->size_class)
+			s->size_class = size_class;
+	} else
+		dropped++;
+	live_bytes += size;
+	if (live_bytes > peak_bytes)
+		peak_bytes = live_bytes;
+	list_push_back (&live_list, &tag->elem);
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+}
+
+/* Records that the allocation with TAG was freed. */
+void
+memtrack_free (struct memtrack_tag *tag) {
+	enum intr_level old_level = intr_disable ();
+	struct memtrack_site *s = tag->site;
+
+	spin_lock (&memtrack_lock);
+	if (s != NULL) {
+		s->frees++;
+		s->live_bytes -= tag->size;
+		if (tag->tid < 0) {
+			s->orphans--;
+			s->orphan_bytes -= tag->size;
+		}
+	}
+	live_bytes -= tag->size;
+	list_remove (&tag->elem);
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+}
+
+/* Records that the allocation with TAG was resized in place to
+   SIZE bytes.  It stays with the call site that allocated it. */
+void
+memtrack_resize (struct memtrack_tag *tag, size_t size) {
+	enum intr_level old_level = intr_disable ();
+	struct memtrack_site *s = tag->site;
+
+	spin_lock (&memtrack_lock);
+	if (s != NULL) {
+		s->live_bytes += size - tag->size;
+		if (s->live_bytes > s->peak_bytes)
+			s->peak_bytes = s->live_bytes;
+		if (tag->tid < 0)
+			s->orphan_bytes += size - tag->size;
+	}
+	live_bytes += size - tag->size;
+	if (live_bytes > peak_bytes)
+		peak_bytes = live_bytes;
+	tag->size = size;
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+}
+
+/* Records that the allocation with tag FROM now has tag TO, for
+   allocators that move memory. */
+void
+memtrack_move (struct memtrack_tag *from, struct memtrack_tag *to) {
+	enum intr_level old_level = intr_disable ();
+
+	spin_lock (&memtrack_lock);
+	to->site = from->site;
+	to->size = from->size;
+	to->tid = from->tid;
+	list_insert (&from->elem, &to->elem);
+	list_remove (&from->elem);
+	from->size = 0;
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+}
+
+/* Counts the live allocations made by T, which is exiting, as
+   orphaned. */
+void
+memtrack_thread_exit (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	struct list_elem *e;
+
+	spin_lock (&memtrack_lock);
+	for (e = list_begin (&live_list); e != list_end (&live_list);
+			e = list_next (e)) {
+		struct memtrack_tag *tag = list_entry (e, struct memtrack_tag, elem);
+
+		if (tag->tid == t->tid) {
+			tag->tid = -1;
+			if (tag->site != NULL) {
+				tag->site->orphans++;
+				tag->site->orphan_bytes += tag->size;
+			}
+		}
+	}
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+}
+
+/* Prints the call sites that have live memory, largest first, and
+   then those with orphaned objects. */
+void
+memtrack_print_stats (void) {
+	static struct memtrack_site snap[SITE_CNT];
+	enum intr_level old_level = intr_disable ();
+	size_t cnt = 0, total, peak, lost;
+
+	/* Copy the table so that printing, which may block on the
+	   console lock, happens outside the spin lock. */
+	spin_lock (&memtrack_lock);
+	for (size_t i = 0; i < SITE_CNT; i++)
+		if (sites[i].caller != NULL)
+			snap[cnt++] = sites[i];
+	total = live_bytes;
+	peak = peak_bytes;
+	lost = dropped;
+	spin_unlock (&memtrack_lock);
+	intr_set_level (old_level);
+
+	/* Insertion sort by live bytes, descending. */
+	for (size_t i = 1; i < cnt; i++) {
+		struct memtrack_site s = snap[i];
+		size_t j;
+
+		for (j = i; j > 0 && snap[j - 1].live_bytes < s.live_bytes; j--)
+			snap[j] = snap[j - 1];
+		snap[j] = s;
+	}
+
+	printf ("Memtrack: %zu bytes live, peak %zu bytes, %zu call sites",
+			total, peak, cnt);
+	if (lost > 0)
+		printf (" (%zu allocations untracked)", lost);
+	printf ("\n");
+	for (size_t i = 0; i < cnt; i++) {
+		const struct memtrack_site *s = &snap[i];
+
+		if (s->live_bytes == 0)
+			continue;
+		printf ("  %p %-6s class %5zu: %8zu live, %8zu peak, "
+				"%llu allocs, %llu frees\n",
+				s->caller, kind_names[s->kind], s->size_class,
+				s->live_bytes, s->peak_bytes, s->allocs, s->frees);
+	}
+	for (size_t i = 0; i < cnt; i++) {
+		const struct memtrack_site *s = &snap[i];
+
+		if (s->orphans > 0)
+			printf ("  possible leak: %p %s, %zu objects (%zu bytes) "
+					"outlived their thread\n",
+					s->caller, kind_names[s->kind], s->orphans,
+					s->orphan_bytes);
+	}
+}
+#endif /* MEMTRACK */
@@ -1,15 +1,141 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <debug.h>
+#include <list.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* TLB tagging.
+ *
+ * Where the CPU supports PCIDs, it tags the TLB entries of
+ * the last PCID_SLOTS user pml4s it ran with PCIDs 1 through
+ * PCID_SLOTS, so that switching back to one of them can keep its
+ * entries (CR3_NOFLUSH).  A pml4 without a PCID takes the least
+ * recently used one, and its first CR3 load flushes whatever the
+ * previous owner left.  base_pml4 maps only the kernel and always
+ * runs with PCID 0.  A pml4 whose entries change while it is not
+ * active, or that is destroyed, loses its PCIDs instead.
+ *
+ * Kernel mappings are global where the CPU supports it, so they
+ * survive every CR3 load, PCIDs or not.  Without PCIDs, every
+ * switch flushes the non-global entries, as before. */
+#define PCID_SLOTS 8
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR4_PGE (1 << 7)
+#define CR4_PCIDE (1 << 17)
+
+/* Which pml4 holds each PCID. */
+struct pcid_cache {
+	uint64_t *owners[PCID_SLOTS];   /* pml4 tagged with PCID I + 1. */
+	uint64_t last_use[PCID_SLOTS];  /* CLOCK at the owner's last load. */
+	uint64_t clock;                 /* # of loads so far. */
+};
+
+static struct pcid_cache pcid_cache;
+static bool pcid_enabled;
+static bool global_pages;
+
+/* Enables global pages and PCIDs, if the CPU has them.  Called
+ * once base_pml4 is active. */
+void
+tlb_init (void) {
+	if (cpu_features & CPU_FEAT_PGE) {
+		lcr4 (rcr4 () | CR4_PGE);
+		global_pages = true;
+
+		/* Flushing all PCIDs relies on toggling CR4.PGE. */
+		if (cpu_features & CPU_FEAT_PCID) {
+			ASSERT ((rcr3 () & PGMASK) == 0);
+			lcr4 (rcr4 () | CR4_PCIDE);
+			pcid_enabled = true;
+		}
+	}
+}
+
+/* Flushes the whole TLB, including global entries and those of
+ * every PCID. */
+static void
+tlb_flush_all (void) {
+	if (global_pages) {
+		uint64_t cr4 = rcr4 ();
+		lcr4 (cr4 & ~CR4_PGE);
+		lcr4 (cr4);
+	} else
+		lcr3 (rcr3 ());
+}
+
+/* Takes every PCID away from PML4, so that its next load flushes
+ * the TLB entries it may have left. */
+static void
+pcid_forget (uint64_t *pml4) {
+	enum intr_level old_level = intr_disable ();
+
+	for (unsigned i = 0; i < PCID_SLOTS; i++)
+		if (pcid_cache.owners[i] == pml4)
+			pcid_cache.owners[i] = NULL;
+	intr_set_level (old_level);
+}
+
+/* Invalidates the translations of the CNT pages starting at VA in
+ * PML4 after a change to their page table entries.  Past
+ * TLB_FLUSH_MAX pages, dropping all of PML4's entries is cheaper
+ * than invalidating them one by one. */
+#define TLB_FLUSH_MAX 32
+static void
+tlb_invalidate_range (uint64_t *pml4, uint64_t va, size_t cnt) {
+	if (PTE_ADDR (rcr3 ()) != vtop (pml4)) {
+		if (pcid_enabled)
+			pcid_forget (pml4);
+	} else if (cnt > TLB_FLUSH_MAX)
+		lcr3 (rcr3 ());
+	else
+		for (size_t i = 0; i < cnt; i++)
+			invlpg (va + PGSIZE * i);
+}
+
+/* Invalidates the translation of VA in PML4 after a change to its
+ * page table entry. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	tlb_invalidate_range (pml4, va, 1);
+}
+
+/* Replaces the large-page entry *ENTRY, which maps SIZE bytes,
+ * by a page table whose entries map the same memory with the same
+ * permissions in pages of SIZE / 512 bytes.  Kernel mappings are
+ * global and shared by every pml4, so the whole TLB is flushed.
+ * Returns false if memory allocation fails. */
+static bool
+split_large (uint64_t *entry, uint64_t size) {
+	uint64_t *table = palloc_get_page (0);
+	uint64_t sub = size / (PGSIZE / sizeof (uint64_t));
+	uint64_t flags = *entry & PTE_FLAGS & ~PTE_PS;
+
+	ASSERT (*entry & PTE_PS);
+	if (table == NULL)
+		return false;
+	if (sub != PGSIZE)
+		flags |= PTE_PS;
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		table[i] = (PTE_ADDR (*entry) + i * sub) | flags;
+	*entry = vtop (table) | PTE_U | PTE_W | PTE_P;
+	tlb_flush_all ();
+	return true;
+}
+
+/* The walkers below stop at a large-page leaf and store the size
+ * it maps into *SIZE, which is PGSIZE for an ordinary PTE.  With
+ * CREATE they split the large page instead, since the caller
+ * wants a 4 kB PTE to change. */
 static uint64_t *
-pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
+pgdir_walk (uint64_t *pdp, const uint64_t va, int create, uint64_t *size) {
 	// pdp : page directory 테이블의 시작 주소
 	// 가상주소에서 page directory 테이블의 엔트리 인덱스를 가상주소에서 추출
 	int idx = PDX (va);
@@ -26,6 +152,15 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		if (pdp[idx] & PTE_PS) {
+			if (!create) {
+				*size = LARGE_PGSIZE;
+				return &pdp[idx];
+			}
+			if (!split_large (&pdp[idx], LARGE_PGSIZE))
+				return NULL;
+		}
+		*size = PGSIZE;
 		// PTX(vaddr): page table에서 몇 번째 엔트리인지 계산
 		// PTE_ADDR: page table의 실제 물리 주소
 		// pte의 커널 가상 주소를 반환
@@ -35,7 +170,7 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 }
 
 static uint64_t *
-pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
+pdpe_walk (uint64_t *pdpe, const uint64_t va, int create, uint64_t *size) {
 	uint64_t *pte = NULL;
 	// page directory pointer테이블의 엔트리 인덱스를 가상주소에서 추출
 	int idx = PDPE (va);
@@ -54,7 +189,15 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
+		if (pdpe[idx] & PTE_PS) {
+			if (!create) {
+				*size = HUGE_PGSIZE;
+				return &pdpe[idx];
+			}
+			if (!split_large (&pdpe[idx], HUGE_PGSIZE))
+				return NULL;
+		}
+		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create, size);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
@@ -72,6 +215,16 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 //  va라는 가상 주소에 대응하는 최종 페이지 테이블 엔트리(PTE)의 주소를 리턴합니다.
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
+	uint64_t size;
+	return pml4e_walk_size (pml4e, va, create, &size);
+}
+
+/* Like pml4e_walk(), but if VA lies in a large page and CREATE is
+ * false, returns the large-page PDE or PDPE instead of a PTE.
+ * Stores the number of bytes the returned entry maps into *SIZE. */
+uint64_t *
+pml4e_walk_size (uint64_t *pml4e, const uint64_t va, int create,
+		uint64_t *size) {
 	uint64_t *pte = NULL;
 	// 가상주소 va에서 pml4인덱스(상위 9비트) 추출
 	int idx = PML4 (va);
@@ -99,7 +252,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 				return NULL;
 		}
 		// 다음단계인 pdpe_walk를 호출하면서 내려감
-		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
+		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create, size);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
@@ -108,6 +261,37 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the address of the entry in PML4 that maps the
+ * SIZE-byte page at VA: a PDPE for HUGE_PGSIZE, a PDE for
+ * LARGE_PGSIZE or a PTE for PGSIZE.  Page tables above it are
+ * created as needed.  Returns a null pointer if memory allocation
+ * fails.  Used to build large-page mappings. */
+uint64_t *
+pml4e_walk_large (uint64_t *pml4, const uint64_t va, uint64_t size) {
+	static const unsigned shifts[] = {
+		PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+	};
+	uint64_t *table = pml4;
+	unsigned i;
+
+	ASSERT (size == PGSIZE || size == LARGE_PGSIZE || size == HUGE_PGSIZE);
+	ASSERT (va % size == 0);
+
+	for (i = 0; (1UL << shifts[i]) > size; i++) {
+		uint64_t *e = &table[(va >> shifts[i]) & 0x1FF];
+
+		if (!(*e & PTE_P)) {
+			uint64_t *new_page = palloc_get_page (PAL_ZERO);
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		ASSERT (!(*e & PTE_PS));
+		table = ptov (PTE_ADDR (*e));
+	}
+	return &table[(va >> shifts[i]) & 0x1FF];
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -146,7 +330,14 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 	//printf("pgdir for each\n");
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((pdp[i] & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS)) {
+			/* 2 MB page: FUNC gets the PDE itself. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pte) & PTE_P)
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -160,7 +351,13 @@ pdp_for_each (uint64_t *pdp,
 	//printf("pdp for each\n");
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pde) & PTE_P)
+		if ((pdp[i] & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS)) {
+			/* 1 GB page: FUNC gets the PDPE itself. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) i << PDPESHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pde) & PTE_P)
 			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
 					 aux, pml4_index, i))
 				return false;
@@ -168,7 +365,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * For a large page, FUNC is applied once, to the PDE or PDPE that
+ * maps it, with VA at the start of the page. */
 // pml4 테이블에 있는 모든 유효한 항복에 대해 func호출함.
 // func가 false 를 반환하면 순회를 중단후 false 반환.
 // 모든 항목에 대해 성공적으로 호출되면 true를 반환
@@ -183,36 +382,6 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
-static void
-pt_destroy (uint64_t *pt) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pte = ptov((uint64_t *) pt[i]);
-		if (((uint64_t) pte) & PTE_P)
-			palloc_free_page ((void *) PTE_ADDR (pte));
-	}
-	palloc_free_page ((void *) pt);
-}
-
-static void
-pgdir_destroy (uint64_t *pdp) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
-	}
-	palloc_free_page ((void *) pdp);
-}
-
-static void
-pdpe_destroy (uint64_t *pdpe) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
-		if (((uint64_t) pde) & PTE_P)
-			pgdir_destroy ((void *) PTE_ADDR (pde));
-	}
-	palloc_free_page ((void *) pdpe);
-}
-
 /* Destroys pml4e, freeing all the pages it references. */
 // 해당 페이지 테이블에 할당된 모든 메모리를 정리하고 해제합니다.
 void
@@ -222,11 +391,10 @@ pml4_destroy (uint64_t *pml4) {
 	ASSERT (pml4 != base_pml4);
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
+	pml4_unmap_range (pml4, NULL, (1UL << PML4SHIFT) / PGSIZE, true);
 
-	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
-	if (((uint64_t) pdpe) & PTE_P)
-		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-
+	if (pcid_enabled)
+		pcid_forget (pml4);
 	palloc_free_page ((void *) pml4);
 }
 
@@ -238,7 +406,42 @@ pml4_destroy (uint64_t *pml4) {
 */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	struct pcid_cache *c;
+	enum intr_level old_level;
+	unsigned slot = 0;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+	if (pml4 == base_pml4) {
+		lcr3 (vtop (pml4) | CR3_NOFLUSH);
+		return;
+	}
+
+	old_level = intr_disable ();
+	c = &pcid_cache;
+	c->clock++;
+	for (unsigned i = 0; i < PCID_SLOTS; i++) {
+		if (c->owners[i] == pml4) {
+			/* Its entries are still good. */
+			c->last_use[i] = c->clock;
+			lcr3 (vtop (pml4) | (i + 1) | CR3_NOFLUSH);
+			intr_set_level (old_level);
+			return;
+		}
+		if (c->last_use[i] < c->last_use[slot])
+			slot = i;
+	}
+
+	/* Evict the least recently used pml4 from its PCID, flushing
+	   what it left behind. */
+	c->owners[slot] = pml4;
+	c->last_use[slot] = c->clock;
+	lcr3 (vtop (pml4) | (slot + 1));
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -254,10 +457,11 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
 	// 테이블 자체가 없으면 그냥 바로 NULL 리턴하게 됨.
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
+	uint64_t size;
+	uint64_t *pte = pml4e_walk_size (pml4, (uint64_t) uaddr, 0, &size);
 
 	if (pte && (*pte & PTE_P))
-		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+		return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & (size - 1));
 	return NULL;
 }
 
@@ -309,8 +513,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
 	}
 }
 
@@ -337,8 +540,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -365,7 +567,296 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
+
+/* Range operations.
+ *
+ * These apply to CNT consecutive user pages at once.  The walk
+ * visits each page table only once, skips the parts of the range
+ * that have no page table, and invalidates the TLB once at the
+ * end. */
+
+/* A walk over a range of PTEs. */
+struct range_walk {
+	uint64_t start;                 /* First address of the range. */
+	bool create;                    /* Create missing page tables? */
+	bool prune;                     /* Free page tables left empty? */
+	/* Called for each PTE in an existing page table, with I the
+	 * index of its page in the range.  Returns false to stop. */
+	bool (*func) (uint64_t *pte, size_t i, void *aux);
+	void *aux;
+	struct list dead_tables;        /* Pruned tables, freed last. */
+};
+
+static bool
+table_is_empty (const uint64_t *table) {
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		if (table[i] != 0)
+			return false;
+	return true;
+}
+
+/* Walks TABLE, a page table at LEVEL (0 for a page table, 3 for a
+ * pml4), from *VA up to END or to the end of TABLE, whichever
+ * comes first, and advances *VA past what it covered. */
+static bool
+walk_range (uint64_t *table, unsigned level, uint64_t *va, uint64_t end,
+		struct range_walk *w) {
+	unsigned shift = PTXSHIFT + 9 * level;
+
+	for (unsigned idx = (*va >> shift) & 0x1FF; idx < 512 && *va < end;
+			idx++) {
+		uint64_t *e = &table[idx];
+		uint64_t next = ((*va >> shift) + 1) << shift;
+		uint64_t *sub;
+		bool ok;
+
+		if (level == 0) {
+			if (!w->func (e, (*va - w->start) / PGSIZE, w->aux))
+				return false;
+			*va = next;
+			continue;
+		}
+
+		if (!(*e & PTE_P)) {
+			if (!w->create) {
+				*va = next;
+				continue;
+			}
+			sub = palloc_get_page (PAL_ZERO);
+			if (sub == NULL)
+				return false;
+			*e = vtop (sub) | PTE_U | PTE_W | PTE_P;
+		}
+		ASSERT (!(*e & PTE_PS));
+
+		sub = ptov (PTE_ADDR (*e));
+		ok = walk_range (sub, level - 1, va, end, w);
+		if (w->prune && table_is_empty (sub)) {
+			/* The table is all zeros, so its first bytes can
+			 * hold the list link. */
+			*e = 0;
+			list_push_back (&w->dead_tables, (struct list_elem *) sub);
+		}
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+/* Runs W over the CNT pages starting at UPAGE in PML4.  Returns
+ * false if W's function stopped the walk or a page table could
+ * not be allocated. */
+static bool
+range_apply (uint64_t *pml4, void *upage, size_t cnt,
+		struct range_walk *w) {
+	uint64_t va = (uint64_t) upage;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (cnt == 0 || is_user_vaddr (va + PGSIZE * cnt - 1));
+
+	w->start = va;
+	list_init (&w->dead_tables);
+	return walk_range (pml4, 3, &va, va + PGSIZE * cnt, w);
+}
+
+/* Frees the page tables that W pruned.  Must come after the TLB
+ * flush, since the CPU may cache paging structures too. */
+static void
+range_free_tables (struct range_walk *w) {
+	while (!list_empty (&w->dead_tables))
+		palloc_free_page (list_pop_front (&w->dead_tables));
+}
+
+struct map_range_aux {
+	void **kpages;
+	bool rw;
+	size_t mapped;
+};
+
+static bool
+map_pte (uint64_t *pte, size_t i, void *aux_) {
+	struct map_range_aux *aux = aux_;
+
+	if (*pte & PTE_P)
+		return false;
+	*pte = vtop (aux->kpages[i]) | PTE_P | (aux->rw ? PTE_W : 0) | PTE_U;
+	aux->mapped++;
+	return true;
+}
+
+/* Maps the CNT user pages starting at UPAGE in PML4 to the frames
+ * at kernel virtual addresses KPAGES[0] through KPAGES[CNT - 1],
+ * read/write if RW is true and read-only otherwise.  None of the
+ * pages may be mapped already.
+ * Returns true if successful.  Returns false, with none of the
+ * pages mapped, if one of them was mapped or memory allocation
+ * failed. */
+bool
+pml4_map_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw) {
+	struct map_range_aux aux = { .kpages = kpages, .rw = rw };
+	struct range_walk w = { .create = true, .func = map_pte, .aux = &aux };
+
+	ASSERT (pml4 != base_pml4);
+
+	if (!range_apply (pml4, upage, cnt, &w)) {
+		pml4_unmap_range (pml4, upage, aux.mapped, false);
+		return false;
+	}
+	return true;
+}
+
+static bool
+unmap_pte (uint64_t *pte, size_t i UNUSED, void *free_frames) {
+	if ((*pte & PTE_P) && *(bool *) free_frames)
+		palloc_free_page (ptov (PTE_ADDR (*pte)));
+	*pte = 0;
+	return true;
+}
+
+/* Removes the mappings of the CNT user pages starting at UPAGE in
+ * PML4, which need not be mapped, and frees the page tables that
+ * are left empty.  If FREE_FRAMES is true, the mapped frames are
+ * given back to the page allocator too. */
+void
+pml4_unmap_range (uint64_t *pml4, void *upage, size_t cnt,
+		bool free_frames) {
+	struct range_walk w = { .prune = true, .func = unmap_pte,
+		.aux = &free_frames };
+
+	range_apply (pml4, upage, cnt, &w);
+	tlb_invalidate_range (pml4, (uint64_t) upage, cnt);
+	range_free_tables (&w);
+}
+
+static bool
+protect_pte (uint64_t *pte, size_t i UNUSED, void *rw) {
+	if (*pte & PTE_P) {
+		if (*(bool *) rw)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+	}
+	return true;
+}
+
+/* Makes the mapped pages among the CNT user pages starting at
+ * UPAGE in PML4 read/write if RW is true, read-only otherwise. */
+void
+pml4_protect_range (uint64_t *pml4, void *upage, size_t cnt, bool rw) {
+	struct range_walk w = { .func = protect_pte, .aux = &rw };
+
+	range_apply (pml4, upage, cnt, &w);
+	tlb_invalidate_range (pml4, (uint64_t) upage, cnt);
+}
+
+struct clear_range_aux {
+	uint64_t bit;                   /* PTE_A or PTE_D. */
+	bool *was_set;                  /* Per page result, or null. */
+	size_t cnt;                     /* # of pages that had BIT. */
+};
+
+static bool
+test_and_clear_pte (uint64_t *pte, size_t i, void *aux_) {
+	struct clear_range_aux *aux = aux_;
+
+	if ((*pte & PTE_P) && (*pte & aux->bit)) {
+		*pte &= ~aux->bit;
+		aux->cnt++;
+		if (aux->was_set != NULL)
+			aux->was_set[i] = true;
+	}
+	return true;
+}
+
+/* Clears BIT in the PTEs of the CNT user pages at UPAGE in PML4
+ * and returns how many had it set.  If WAS_SET is nonnull, stores
+ * into WAS_SET[I] whether page I had it set. */
+static size_t
+test_and_clear_range (uint64_t *pml4, void *upage, size_t cnt,
+		uint64_t bit, bool *was_set) {
+	struct clear_range_aux aux = { .bit = bit, .was_set = was_set };
+	struct range_walk w = { .func = test_and_clear_pte, .aux = &aux };
+
+	if (was_set != NULL)
+		memset (was_set, 0, sizeof *was_set * cnt);
+	range_apply (pml4, upage, cnt, &w);
+	if (aux.cnt > 0)
+		tlb_invalidate_range (pml4, (uint64_t) upage, cnt);
+	return aux.cnt;
+}
+
+/* Clears the accessed bits of the CNT user pages starting at UPAGE
+ * in PML4 and returns how many were set.  If ACCESSED is nonnull,
+ * ACCESSED[I] is set to whether page I had been accessed. */
+size_t
+pml4_test_and_clear_accessed_range (uint64_t *pml4, void *upage,
+		size_t cnt, bool *accessed) {
+	return test_and_clear_range (pml4, upage, cnt, PTE_A, accessed);
+}
+
+/* Clears the dirty bits of the CNT user pages starting at UPAGE in
+ * PML4 and returns how many were set.  If DIRTY is nonnull,
+ * DIRTY[I] is set to whether page I had been written. */
+size_t
+pml4_test_and_clear_dirty_range (uint64_t *pml4, void *upage,
+		size_t cnt, bool *dirty) {
+	return test_and_clear_range (pml4, upage, cnt, PTE_D, dirty);
+}
+
+struct remap_aux {
+	uint64_t *pml4;
+	uint64_t base;                  /* Physical address of the frames. */
+	size_t cnt;                     /* # of frames. */
+	void **new_kpages;
+	size_t *refs;
+	size_t found;                   /* # of PTEs that mapped one. */
+};
+
+static bool
+remap_pte (uint64_t *pte, size_t i, void *aux_) {
+	struct remap_aux *aux = aux_;
+	uint64_t pa = PTE_ADDR (*pte);
+	size_t f;
+
+	if (!(*pte & PTE_P) || pa < aux->base
+			|| pa >= aux->base + PGSIZE * aux->cnt)
+		return true;
+
+	f = (pa - aux->base) / PGSIZE;
+	if (aux->refs != NULL)
+		aux->refs[f]++;
+	if (aux->new_kpages != NULL && aux->new_kpages[f] != NULL) {
+		*pte = vtop (aux->new_kpages[f]) | (*pte & PTE_FLAGS);
+		tlb_invalidate (aux->pml4, PGSIZE * i);
+	}
+	aux->found++;
+	return true;
+}
+
+/* Finds the user pages of PML4 that map one of the CNT frames
+ * starting at kernel virtual address KPAGE, and returns how many
+ * there are.  For each such page mapping frame I, increments
+ * REFS[I] if REFS is nonnull, and if NEW_KPAGES and NEW_KPAGES[I]
+ * are nonnull, points the page at frame NEW_KPAGES[I] instead,
+ * keeping its permissions and accessed and dirty bits.  Used to
+ * migrate frames; copying them is up to the caller. */
+size_t
+pml4_remap_frames (uint64_t *pml4, void *kpage, size_t cnt,
+		void **new_kpages, size_t *refs) {
+	struct remap_aux aux = {
+		.pml4 = pml4, .base = vtop (kpage), .cnt = cnt,
+		.new_kpages = new_kpages, .refs = refs,
+	};
+	struct range_walk w = { .func = remap_pte, .aux = &aux };
+
+	ASSERT (pml4 != base_pml4);
+	ASSERT (pg_ofs (kpage) == 0);
+
+	/* User pages live below pml4 entry 1, as in pml4_destroy(). */
+	range_apply (pml4, NULL, (1UL << PML4SHIFT) / PGSIZE, &w);
+	return aux.found;
+}
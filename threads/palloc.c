@@ -2,16 +2,24 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/memtrack.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -29,15 +37,101 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**K pages, aligned to 2**K pages from the pool base,
+   on one free list per order K.  An allocation of N pages splits
+   the smallest block that fits and gives back the unused tail;
+   a free breaks the pages into aligned blocks and merges each
+   with its buddy for as long as the buddy is free too.  Both are
+   O(log n).  The free list links live in the free pages
+   themselves, and ORDER_MAP remembers, per page, whether it
+   heads a free block and of which order.
+   각 풀은 buddy 할당기로 관리된다.
+
+   A pool is guarded by a spin lock taken with interrupts off,
+   so pages can be freed from the scheduler (see do_schedule()),
+   where a sleeping lock must not block.
+
+   Single pages, by far the most common request, mostly bypass
+   the pool: each pool keeps a magazine of free pages taken from
+   its free lists, which is popped from and pushed to with only
+   interrupts off.  An empty magazine is refilled, and a full one drained,
+   MAG_BATCH pages at a time under the pool lock.  Pages in a
+   magazine count as used in the pool's used_map.
+
+   The idle thread zeroes free pages ahead of time, through
+   palloc_zero_idle(), onto a list of pre-zeroed pages that
+   single-page PAL_ZERO requests take from before falling back to
+   memset().  Like magazine pages, pre-zeroed pages count as used;
+   the list link lives in the first bytes of each page and is
+   cleared when the page is handed out.
+
+   With MEMTRACK, each pool also keeps a table of memtrack tags,
+   one per page, next to its bitmaps.  The tag of the first page of
+   an allocation is the allocation's.
+
+   When a multi-page user request fails for lack of a large enough
+   free block, compact_pool() makes one: it picks the aligned
+   window of the user pool with the fewest used pages, copies those
+   pages elsewhere, and points every user page table entry that
+   mapped them at the copies.  The only pages it moves are those
+   it finds mapped in some process's pml4; if any used page in the
+   window is not, it gives up.  With VM, each of those pages is
+   also a frame whose kernel address the frame table keeps, so
+   compaction holds the frame table throughout and lets
+   vm_migrate_frames() update it, or refuse if a frame is pinned. */
+
+/* Largest block order: 2**18 pages, or 1 GB. */
+#define MAX_ORDER 18
+
+/* Cache of free pages in front of a pool. */
+#define MAG_SIZE 32                     /* Capacity of a magazine. */
+#define MAG_BATCH (MAG_SIZE / 2)        /* Pages moved per refill/drain. */
+struct magazine {
+	size_t cnt;                         /* # of pages in PAGES. */
+	void *pages[MAG_SIZE];              /* Free pages, hottest last. */
+	unsigned long long hits;            /* Allocations served from PAGES. */
+	unsigned long long misses;          /* Allocations that had to refill. */
+	unsigned long long drains;          /* Frees that found PAGES full. */
+};
+
+/* Most pre-zeroed pages kept per pool.  The idle thread also
+   leaves at least this many pages free in the pool. */
+#define ZERO_MAX 64
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
+	struct spinlock lock;           /* Mutual exclusion. */
 	// 메모리 풀에 있는 페이지들이 사용중인지 아닌지를 기록
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	// 메모리 풀의 시작 주소
 	uint8_t *base;                  /* Base of pool. */
+	const char *name;               /* Name, for statistics. */
+
+	/* Buddy allocator. */
+	struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+	uint32_t free_orders;           /* Bit K set iff free_lists[K] nonempty. */
+	uint8_t *order_map;             /* K + 1 at a free block's head, else 0. */
+	size_t free_cnt;                /* # of free pages. */
+
+	struct magazine mag;            /* Free page cache. */
+
+	/* Pre-zeroed pages. */
+	struct list zeroed;             /* Zeroed free pages. */
+	size_t zeroed_cnt;              /* # of pages in ZEROED. */
+	unsigned long long zero_hits;   /* PAL_ZERO served from ZEROED. */
+	unsigned long long zero_misses; /* PAL_ZERO that had to memset(). */
+
+	/* Compaction. */
+	unsigned long long compactions; /* Successful compactions. */
+	unsigned long long compact_fails; /* Compactions given up. */
+	unsigned long long migrated;    /* Pages moved by compaction. */
+
+#ifdef MEMTRACK
+	struct memtrack_tag *tags;      /* Accounting, by page index. */
+#endif
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -46,9 +140,27 @@ static struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 static void
-init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
+init_pool (struct pool *p, const char *name, void **bm_base,
+		uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void buddy_init (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static bool buddy_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (struct pool *);
+static void *pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *magazine_get (struct pool *);
+static void magazine_put (struct pool *, void *page);
+static bool magazine_drain_all (struct pool *);
+static void *zeroed_get (struct pool *);
+static bool zeroed_drain (struct pool *);
+static void *get_pages (enum palloc_flags, size_t page_cnt,
+		const void *caller);
+#ifdef USERPROG
+static void *compact_pool (struct pool *, size_t page_cnt);
+#endif
 
 /* multiboot info */
 struct multiboot_info {
@@ -165,7 +277,7 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 						break;
 					}
 					// generate kernel pool
-					init_pool (&kernel_pool,
+					init_pool (&kernel_pool, "kernel_pool",
 							&free_start, region_start, start + rem * PGSIZE);
 					// Transition to the next state
 					if (rem == size_in_pg) {
@@ -195,7 +307,7 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 	}
 
 	// generate the user pool
-	init_pool(&user_pool, &free_start, region_start, end);
+	init_pool(&user_pool, "user_pool", &free_start, region_start, end);
 
 	// Iterate over the e820_entry. Setup the usable.
 	uint64_t usable_bound = (uint64_t) free_start;
@@ -239,6 +351,9 @@ split:
 			}
 		}
 	}
+
+	buddy_init (&kernel_pool);
+	buddy_init (&user_pool);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -270,21 +385,59 @@ palloc_init (void) {
 // 커널 가상주소를 반환
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return get_pages (flags, page_cnt, MEMTRACK_CALLER);
+}
+
+/* Does palloc_get_multiple() on behalf of the function at
+   CALLER. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt,
+		const void *caller UNUSED) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
+	void *pages = NULL;
+	bool zeroed = false;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	if (page_cnt == 0)
+		return NULL;
+
+	if (page_cnt == 1 && (flags & PAL_ZERO)) {
+		pages = zeroed_get (pool);
+		zeroed = pages != NULL;
+	}
+	if (pages == NULL && page_cnt == 1)
+		pages = magazine_get (pool);
+	if (pages == NULL)
+		pages = pool_alloc (pool, page_cnt);
+
+	/* Pages may be sitting in the magazine or on the pre-zeroed list.
+	   Give them back and retry. */
+	if (pages == NULL
+			&& (magazine_drain_all (pool) | zeroed_drain (pool)))
+		pages = pool_alloc (pool, page_cnt);
+
+	/* Slab caches may be holding empty slabs.  Those land in our
+	   magazine when freed, so drain it again before retrying. */
+	if (pages == NULL && pool == &kernel_pool && !intr_context ()
+			&& kmem_reclaim () > 0) {
+		magazine_drain_all (pool);
+		pages = pool_alloc (pool, page_cnt);
+	}
+
+#ifdef USERPROG
+	/* The user pool may have the pages, just not in one place. */
+	if (pages == NULL && pool == &user_pool && page_cnt > 1
+			&& !intr_context ())
+		pages = compact_pool (pool, page_cnt);
+#endif
 
 	if (pages) {
-		if (flags & PAL_ZERO)
+		if ((flags & PAL_ZERO) && !zeroed)
 			memset (pages, 0, PGSIZE * page_cnt);
+#ifdef MEMTRACK
+		memtrack_alloc (&pool->tags[pg_no (pages) - pg_no (pool->base)],
+				MEMTRACK_PALLOC, caller, PGSIZE * page_cnt, page_cnt);
+#endif
 	} else {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
@@ -302,7 +455,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	return get_pages (flags, 1, MEMTRACK_CALLER);
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -324,11 +477,73 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 
 	page_idx = pg_no (pages) - pg_no (pool->base);
 
+#ifdef MEMTRACK
+	/* Allocations freed piecemeal are accounted to their first
+	   page, so only a tagged page has anything to untrack. */
+	if (pool->tags[page_idx].size > 0) {
+		memtrack_free (&pool->tags[page_idx]);
+		pool->tags[page_idx].size = 0;
+	}
+#endif
+
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (page_cnt == 1)
+		magazine_put (pool, pages);
+	else
+		pool_free (pool, page_idx, page_cnt);
+}
+
+/* Resizes the PAGE_CNT-page allocation at PAGES to NEW_CNT pages
+   without moving it.  Shrinking frees the pages past NEW_CNT and
+   always succeeds.  Growing claims the pages that follow the
+   allocation, and fails, returning false, unless all of them are
+   free in the pool. */
+bool
+palloc_resize_multiple (void *pages, size_t page_cnt, size_t new_cnt) {
+	struct pool *pool;
+	size_t page_idx;
+	bool ok = true;
+
+	ASSERT (pg_ofs (pages) == 0);
+	ASSERT (pages != NULL && page_cnt > 0 && new_cnt > 0);
+
+	if (page_from_pool (&kernel_pool, pages))
+		pool = &kernel_pool;
+	else if (page_from_pool (&user_pool, pages))
+		pool = &user_pool;
+	else
+		NOT_REACHED ();
+
+	page_idx = pg_no (pages) - pg_no (pool->base);
+	if (new_cnt < page_cnt) {
+		/* The tail is untagged, so this only returns its pages. */
+		palloc_free_multiple ((uint8_t *) pages + PGSIZE * new_cnt,
+				page_cnt - new_cnt);
+	} else if (new_cnt > page_cnt) {
+		size_t extra_idx = page_idx + page_cnt;
+		size_t extra_cnt = new_cnt - page_cnt;
+		enum intr_level old_level;
+
+		if (extra_idx + extra_cnt > bitmap_size (pool->used_map))
+			return false;
+
+		old_level = intr_disable ();
+		spin_lock (&pool->lock);
+		ok = buddy_claim (pool, extra_idx, extra_cnt);
+		if (ok)
+			bitmap_set_multiple (pool->used_map, extra_idx, extra_cnt, true);
+		spin_unlock (&pool->lock);
+		intr_set_level (old_level);
+	}
+
+#ifdef MEMTRACK
+	if (ok && pool->tags[page_idx].size > 0)
+		memtrack_resize (&pool->tags[page_idx], PGSIZE * new_cnt);
+#endif
+	return ok;
 }
 
 /* Frees the page at PAGE. */
@@ -338,23 +553,644 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END */
+/* Zeroes one free page onto the pre-zeroed list of a pool that
+   is short of them.  Returns false if there was nothing to do.
+   Called by the idle thread with interrupts on, which stay on
+   while the page is zeroed, so that the caller can stop as soon
+   as a thread becomes ready. */
+bool
+palloc_zero_idle (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	for (size_t i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+		enum intr_level old_level;
+		size_t page_idx;
+		void *page;
+
+		/* Unlocked peek: being off by a page is harmless. */
+		if (pool->zeroed_cnt >= ZERO_MAX || pool->free_cnt <= ZERO_MAX)
+			continue;
+
+		old_level = intr_disable ();
+		spin_lock (&pool->lock);
+		page_idx = buddy_alloc (pool, 1);
+		if (page_idx != BITMAP_ERROR)
+			bitmap_mark (pool->used_map, page_idx);
+		spin_unlock (&pool->lock);
+		intr_set_level (old_level);
+		if (page_idx == BITMAP_ERROR)
+			continue;
+
+		page = pool->base + PGSIZE * page_idx;
+		memset (page, 0, PGSIZE);
+
+		old_level = intr_disable ();
+		spin_lock (&pool->lock);
+		list_push_back (&pool->zeroed, page);
+		pool->zeroed_cnt++;
+		spin_unlock (&pool->lock);
+		intr_set_level (old_level);
+		return true;
+	}
+	return false;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) {
+	return bitmap_size (user_pool.used_map);
+}
+
+/* Prints the free space and fragmentation of each pool. */
+void
+palloc_print_stats (void) {
+	print_pool_stats (&kernel_pool);
+	print_pool_stats (&user_pool);
+}
+
+/* Initializes pool P, named NAME, as starting at START and ending
+   at END */
 static void
-init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+init_pool (struct pool *p, const char *name, void **bm_base,
+		uint64_t start, uint64_t end) {
+  /* We'll put the pool's used_map and order_map at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t om_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
+#ifdef MEMTRACK
+	size_t tag_pages = DIV_ROUND_UP (pgcnt * sizeof *p->tags, PGSIZE) * PGSIZE;
+#endif
 
-	lock_init(&p->lock);
+	spinlock_init (&p->lock, name);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->name = name;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
-	*bm_base += bm_pages;
+	// The buddy lists stay empty until buddy_init().
+	for (int order = 0; order <= MAX_ORDER; order++)
+		list_init (&p->free_lists[order]);
+	p->free_orders = 0;
+	p->order_map = (uint8_t *) *bm_base + bm_pages;
+	memset (p->order_map, 0, pgcnt);
+	p->free_cnt = 0;
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+
+	*bm_base += bm_pages + om_pages;
+#ifdef MEMTRACK
+	p->tags = *bm_base;
+	memset (p->tags, 0, pgcnt * sizeof *p->tags);
+	*bm_base += tag_pages;
+#endif
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL itself, bypassing
+   the magazine.  Returns a null pointer on failure. */
+static void *
+pool_alloc (struct pool *pool, size_t page_cnt) {
+	enum intr_level old_level = intr_disable ();
+	size_t page_idx;
+
+	spin_lock (&pool->lock);
+	page_idx = buddy_alloc (pool, page_cnt);
+	if (page_idx != BITMAP_ERROR)
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+
+	return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Returns PAGE_CNT pages starting at PAGE_IDX to POOL itself. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	enum intr_level old_level = intr_disable ();
+
+	spin_lock (&pool->lock);
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	buddy_free (pool, page_idx, page_cnt);
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+}
+
+/* Pops a page from POOL's magazine, refilling the
+   magazine from POOL first if it is empty.  Returns a null
+   pointer if both are empty. */
+static void *
+magazine_get (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	struct magazine *mag = &pool->mag;
+	void *page = NULL;
+
+	if (mag->cnt > 0)
+		mag->hits++;
+	else {
+		mag->misses++;
+		spin_lock (&pool->lock);
+		while (mag->cnt < MAG_BATCH) {
+			size_t page_idx = buddy_alloc (pool, 1);
+
+			if (page_idx == BITMAP_ERROR)
+				break;
+			bitmap_mark (pool->used_map, page_idx);
+			mag->pages[mag->cnt++] = pool->base + PGSIZE * page_idx;
+		}
+		spin_unlock (&pool->lock);
+	}
+
+	if (mag->cnt > 0)
+		page = mag->pages[--mag->cnt];
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Moves the oldest CNT pages of MAG back to POOL, whose lock must
+   be held. */
+static void
+magazine_drain (struct pool *pool, struct magazine *mag, size_t cnt) {
+	ASSERT (cnt <= mag->cnt);
+
+	for (size_t i = 0; i < cnt; i++) {
+		size_t page_idx = pg_no (mag->pages[i]) - pg_no (pool->base);
+
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	mag->cnt -= cnt;
+	memmove (mag->pages, mag->pages + cnt, sizeof *mag->pages * mag->cnt);
+}
+
+/* Pushes free PAGE onto POOL's magazine, first
+   draining the magazine's oldest pages to POOL if it is full. */
+static void
+magazine_put (struct pool *pool, void *page) {
+	enum intr_level old_level = intr_disable ();
+	struct magazine *mag = &pool->mag;
+
+	if (mag->cnt == MAG_SIZE) {
+		mag->drains++;
+		spin_lock (&pool->lock);
+		magazine_drain (pool, mag, MAG_BATCH);
+		spin_unlock (&pool->lock);
+	}
+	mag->pages[mag->cnt++] = page;
+	intr_set_level (old_level);
+}
+
+/* Returns every page in POOL's magazine to POOL, so that
+   they can be merged into larger blocks.  Returns true if there
+   were any. */
+static bool
+magazine_drain_all (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	bool drained = false;
+
+	spin_lock (&pool->lock);
+	if (pool->mag.cnt > 0) {
+		magazine_drain (pool, &pool->mag, pool->mag.cnt);
+		drained = true;
+	}
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+
+	return drained;
+}
+
+/* Pops a page off POOL's pre-zeroed list.  Returns a null pointer
+   if the list is empty. */
+static void *
+zeroed_get (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	struct list_elem *e = NULL;
+
+	spin_lock (&pool->lock);
+	if (pool->zeroed_cnt > 0) {
+		e = list_pop_front (&pool->zeroed);
+		pool->zeroed_cnt--;
+		pool->zero_hits++;
+	} else
+		pool->zero_misses++;
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+
+	/* The link was the only nonzero part of the page. */
+	if (e != NULL)
+		memset (e, 0, sizeof *e);
+	return e;
+}
+
+/* Returns every pre-zeroed page of POOL to POOL.  Returns true if
+   there were any. */
+static bool
+zeroed_drain (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	bool drained;
+
+	spin_lock (&pool->lock);
+	drained = pool->zeroed_cnt > 0;
+	while (!list_empty (&pool->zeroed)) {
+		void *page = list_pop_front (&pool->zeroed);
+		size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	pool->zeroed_cnt = 0;
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+
+	return drained;
+}
+
+/* Returns the free list element stored in page PAGE_IDX of POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx) {
+	return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page that holds free list element E. */
+static size_t
+block_idx (struct pool *pool, struct list_elem *e) {
+	return pg_no (e) - pg_no (pool->base);
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX on its free
+   list. */
+static void
+block_push (struct pool *pool, size_t page_idx, int order) {
+	list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+	pool->free_orders |= 1u << order;
+	pool->order_map[page_idx] = order + 1;
+}
+
+/* Takes the free block of 2**ORDER pages at PAGE_IDX off its
+   free list. */
+static void
+block_remove (struct pool *pool, size_t page_idx, int order) {
+	ASSERT (pool->order_map[page_idx] == order + 1);
+
+	list_remove (block_elem (pool, page_idx));
+	if (list_empty (&pool->free_lists[order]))
+		pool->free_orders &= ~(1u << order);
+	pool->order_map[page_idx] = 0;
+}
+
+/* Builds POOL's free lists from the free pages of its used_map. */
+static void
+buddy_init (struct pool *pool) {
+	size_t pgcnt = bitmap_size (pool->used_map);
+	size_t idx = 0;
+
+	while (idx < pgcnt) {
+		size_t start = bitmap_scan (pool->used_map, idx, 1, false);
+		size_t end;
+
+		if (start == BITMAP_ERROR)
+			break;
+		end = bitmap_scan (pool->used_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = pgcnt;
+		buddy_free (pool, start, end - start);
+		idx = end;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, whose lock must
+   be held, and returns the index of the first one, or
+   BITMAP_ERROR if no block is large enough.  The smallest free
+   block of at least PAGE_CNT pages is split in halves down to
+   size, and pages past PAGE_CNT go back on the free lists. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	int order = page_cnt <= 1 ? 0 : 64 - __builtin_clzll (page_cnt - 1);
+	uint32_t candidates;
+	size_t page_idx;
+	int k;
+
+	if (order > MAX_ORDER)
+		return BITMAP_ERROR;
+	candidates = pool->free_orders & ~((1u << order) - 1);
+	if (candidates == 0)
+		return BITMAP_ERROR;
+
+	k = __builtin_ctz (candidates);
+	page_idx = block_idx (pool, list_front (&pool->free_lists[k]));
+	block_remove (pool, page_idx, k);
+	while (k > order) {
+		k--;
+		block_push (pool, page_idx + ((size_t) 1 << k), k);
+	}
+	pool->free_cnt -= (size_t) 1 << order;
+
+	if (page_cnt < ((size_t) 1 << order))
+		buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return page_idx;
+}
+
+/* Returns PAGE_CNT pages starting at PAGE_IDX to POOL, whose lock
+   must be held (or which is not in use yet).  The range is cut
+   into the largest aligned blocks it contains, and each block is
+   merged with its buddy while the buddy is a free block of the
+   same order. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t pgcnt = bitmap_size (pool->used_map);
+
+	pool->free_cnt += page_cnt;
+	while (page_cnt > 0) {
+		int order = page_idx == 0 ? MAX_ORDER : __builtin_ctzll (page_idx);
+		int fit = 63 - __builtin_clzll (page_cnt);
+		size_t idx = page_idx;
+
+		if (order > fit)
+			order = fit;
+		if (order > MAX_ORDER)
+			order = MAX_ORDER;
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+
+		while (order < MAX_ORDER) {
+			size_t buddy = idx ^ ((size_t) 1 << order);
+
+			if (buddy + ((size_t) 1 << order) > pgcnt
+					|| pool->order_map[buddy] != order + 1)
+				break;
+			block_remove (pool, buddy, order);
+			if (buddy < idx)
+				idx = buddy;
+			order++;
+		}
+		block_push (pool, idx, order);
+	}
+}
+
+/* Takes the PAGE_CNT pages starting at PAGE_IDX off POOL's free
+   lists, where POOL's lock must be held.  Returns false, leaving
+   POOL unchanged, unless every one of them is free.  Each free
+   block overlapping the range is removed whole, and its pages
+   outside the range are freed again. */
+static bool
+buddy_claim (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t end = page_idx + page_cnt;
+	size_t idx = page_idx;
+
+	/* Pages in the magazine and on the pre-zeroed list are marked
+	   used, so a clear bit means the page is on a free list. */
+	if (!bitmap_none (pool->used_map, page_idx, page_cnt))
+		return false;
+
+	while (idx < end) {
+		size_t head = idx;
+		int order;
+
+		/* Find the free block that contains IDX. */
+		for (order = 0; order <= MAX_ORDER; order++) {
+			head = idx & ~(((size_t) 1 << order) - 1);
+			if (pool->order_map[head] == order + 1)
+				break;
+		}
+		ASSERT (order <= MAX_ORDER);
+
+		block_remove (pool, head, order);
+		pool->free_cnt -= (size_t) 1 << order;
+		idx = head + ((size_t) 1 << order);
+
+		if (head < page_idx)
+			buddy_free (pool, head, page_idx - head);
+		if (idx > end)
+			buddy_free (pool, end, idx - end);
+	}
+	return true;
+}
+
+#ifdef USERPROG
+/* Largest request that compaction serves: 2**9 pages, or 2 MB. */
+#define COMPACT_MAX_ORDER 9
+#define COMPACT_MAX ((size_t) 1 << COMPACT_MAX_ORDER)
+
+/* Plan of a compaction, indexed by page in the window. */
+static struct compaction {
+	uint8_t *window;                /* First page of the window. */
+	size_t cnt;                     /* # of pages in the window. */
+	bool used[COMPACT_MAX];         /* Was the page in use? */
+	void *dst[COMPACT_MAX];         /* Where a used page moves to. */
+	size_t refs[COMPACT_MAX];       /* # of user mappings of a used page. */
+} compaction;
+
+/* Counts the user mappings of the window's pages in T. */
+static void
+compact_count (struct thread *t, void *aux) {
+	struct compaction *c = aux;
+
+	if (t->pml4 != NULL)
+		pml4_remap_frames (t->pml4, c->window, c->cnt, NULL, c->refs);
+}
+
+/* Points T's mappings of the window's pages at their new frames. */
+static void
+compact_remap (struct thread *t, void *aux) {
+	struct compaction *c = aux;
+
+	if (t->pml4 != NULL)
+		pml4_remap_frames (t->pml4, c->window, c->cnt, c->dst, NULL);
+}
+
+/* Tries to free a block of PAGE_CNT contiguous pages in POOL by
+   migrating the user pages in the way, and returns it allocated,
+   or a null pointer on failure.  Runs with interrupts off and
+   POOL's lock held throughout, so no user page can be touched
+   while it moves; this relies on there being a single CPU.  With
+   VM, it also holds the frame table, which must be locked first,
+   before interrupts go off. */
+static void *
+compact_pool (struct pool *pool, size_t page_cnt) {
+	struct compaction *c = &compaction;
+	int order = 64 - __builtin_clzll (page_cnt - 1);
+	size_t win = (size_t) 1 << order;
+	size_t pgcnt = bitmap_size (pool->used_map);
+	size_t best = BITMAP_ERROR, best_used = win, moved = 0;
+	enum intr_level old_level;
+	bool ok = true;
+
+	if (order > COMPACT_MAX_ORDER)
+		return NULL;
+#ifdef VM
+	if (!vm_migrate_begin ())
+		return NULL;
+#endif
+
+	old_level = intr_disable ();
+	spin_lock (&pool->lock);
+
+	/* buddy_alloc() needs an aligned block, so consider aligned
+	   windows only.  Pick the one with the fewest used pages whose
+	   pages fit in the free space outside it. */
+	for (size_t base = 0; base + win <= pgcnt; base += win) {
+		size_t used = bitmap_count (pool->used_map, base, win, true);
+
+		if (used < best_used && used <= pool->free_cnt - (win - used)) {
+			best = base;
+			best_used = used;
+		}
+	}
+	if (best == BITMAP_ERROR) {
+		pool->compact_fails++;
+		spin_unlock (&pool->lock);
+		intr_set_level (old_level);
+#ifdef VM
+		vm_migrate_end ();
+#endif
+		return NULL;
+	}
+
+	/* Claim the window's free pages so that nothing lands in it,
+	   then find a new frame outside it for each used page. */
+	c->window = pool->base + PGSIZE * best;
+	c->cnt = win;
+	for (size_t i = 0; i < win; i++) {
+		c->used[i] = bitmap_test (pool->used_map, best + i);
+		c->dst[i] = NULL;
+		c->refs[i] = 0;
+		if (!c->used[i]) {
+			ok = buddy_claim (pool, best + i, 1);
+			ASSERT (ok);
+			bitmap_mark (pool->used_map, best + i);
+		}
+	}
+	for (size_t i = 0; i < win && ok; i++)
+		if (c->used[i]) {
+			size_t dst = buddy_alloc (pool, 1);
+
+			if (dst == BITMAP_ERROR)
+				ok = false;
+			else {
+				bitmap_mark (pool->used_map, dst);
+				c->dst[i] = pool->base + PGSIZE * dst;
+			}
+		}
+
+	/* A used page that no process maps belongs to someone who
+	   holds its kernel address, or is unusable memory, or is in
+	   a magazine.  We cannot move it. */
+	if (ok) {
+		thread_foreach (compact_count, c);
+		for (size_t i = 0; i < win; i++)
+			if (c->used[i] && c->refs[i] == 0)
+				ok = false;
+	}
+#ifdef VM
+	/* Frames that someone has pinned may be in use through their
+	   kernel address, and must stay put. */
+	if (ok)
+		ok = vm_migrate_frames (c->window, c->cnt, c->dst);
+#endif
+
+	if (ok) {
+		for (size_t i = 0; i < win; i++)
+			if (c->used[i]) {
+				memcpy (c->dst[i], c->window + PGSIZE * i, PGSIZE);
+#ifdef MEMTRACK
+				if (pool->tags[best + i].size > 0)
+					memtrack_move (&pool->tags[best + i],
+							&pool->tags[pg_no (c->dst[i]) - pg_no (pool->base)]);
+#endif
+				moved++;
+			}
+		thread_foreach (compact_remap, c);
+
+		/* The window is ours.  Keep PAGE_CNT pages of it. */
+		bitmap_set_multiple (pool->used_map, best + page_cnt,
+				win - page_cnt, false);
+		buddy_free (pool, best + page_cnt, win - page_cnt);
+		pool->compactions++;
+		pool->migrated += moved;
+	} else {
+		for (size_t i = 0; i < win; i++) {
+			if (c->dst[i] != NULL) {
+				size_t dst = pg_no (c->dst[i]) - pg_no (pool->base);
+
+				bitmap_reset (pool->used_map, dst);
+				buddy_free (pool, dst, 1);
+			}
+			if (!c->used[i]) {
+				bitmap_reset (pool->used_map, best + i);
+				buddy_free (pool, best + i, 1);
+			}
+		}
+		pool->compact_fails++;
+	}
+
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+#ifdef VM
+	vm_migrate_end ();
+#endif
+	return ok ? c->window : NULL;
+}
+#endif /* USERPROG */
+
+/* Prints POOL's free pages, its free blocks by order, and its
+   external fragmentation: the share of free pages that are not
+   in the largest free block, and so cannot serve the largest
+   request that would otherwise fit. */
+static void
+print_pool_stats (struct pool *pool) {
+	size_t largest = 0, free_cnt;
+	size_t blocks[MAX_ORDER + 1];
+	int top = -1;
+	unsigned long long hits, misses, drains;
+	size_t cached, zeroed_cnt;
+	unsigned long long zero_hits, zero_misses;
+	unsigned long long compactions, compact_fails, migrated;
+	enum intr_level old_level = intr_disable ();
+
+	spin_lock (&pool->lock);
+	free_cnt = pool->free_cnt;
+	zeroed_cnt = pool->zeroed_cnt;
+	zero_hits = pool->zero_hits;
+	zero_misses = pool->zero_misses;
+	compactions = pool->compactions;
+	compact_fails = pool->compact_fails;
+	migrated = pool->migrated;
+	hits = pool->mag.hits;
+	misses = pool->mag.misses;
+	drains = pool->mag.drains;
+	cached = pool->mag.cnt;
+	for (int order = 0; order <= MAX_ORDER; order++) {
+		blocks[order] = list_size (&pool->free_lists[order]);
+		if (blocks[order] > 0)
+			top = order;
+	}
+	spin_unlock (&pool->lock);
+	intr_set_level (old_level);
+
+	if (top >= 0)
+		largest = (size_t) 1 << top;
+	printf ("Palloc %s: %zu of %zu pages free, largest block %zu pages, "
+			"fragmentation %zu%%\n", pool->name, free_cnt,
+			bitmap_size (pool->used_map), largest,
+			free_cnt > 0 ? 100 - largest * 100 / free_cnt : 0);
+	printf ("  free blocks by order:");
+	for (int order = 0; order <= top; order++)
+		printf (" %zu", blocks[order]);
+	printf ("\n");
+	printf ("  magazine: %llu hits, %llu misses (%llu%% hit rate), "
+			"%llu drains, %zu pages cached\n", hits, misses,
+			hits + misses > 0 ? hits * 100 / (hits + misses) : 0,
+			drains, cached);
+	printf ("  pre-zeroed: %llu hits, %llu misses, %zu pages ready\n",
+			zero_hits, zero_misses, zeroed_cnt);
+	if (compactions + compact_fails > 0)
+		printf ("  compaction: %llu done, %llu failed, %llu pages migrated\n",
+				compactions, compact_fails, migrated);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -0,0 +1,362 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/memtrack.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size objects.
+
+   A cache hands out objects of one size.  Objects live in slabs,
+   each a single page that starts with a struct slab header.  The
+   header is followed by an array of free-list links, one per
+   object, then by the objects themselves, so the free list never
+   touches object memory and a constructor's work survives a free.
+
+   Each cache keeps three lists of slabs: partial (some objects
+   free), full (none free) and empty (all free).  Allocation takes
+   from a partial slab, then an empty one, and only then asks the
+   page allocator for a new slab.  Empty slabs are not given back
+   right away, since the next allocation would probably need them
+   again; they are released by kmem_cache_shrink(), or by
+   kmem_reclaim() when the page allocator runs out of memory.
+
+   Compared to malloc(), an object costs its size rounded up to 8
+   bytes plus a 2-byte link, rather than its size rounded up to a
+   power of 2, and slabs are not churned on every free.
+
+   free() recognizes slab objects by the magic number at the start
+   of their page, so code that frees with free() keeps working
+   when its objects move to a cache.
+
+   With MEMTRACK, each object is followed by a struct memtrack_tag,
+   so objects are STRIDE bytes apart rather than SIZE. */
+
+/* Magic number for detecting slab corruption.  It sits where
+   malloc()'s arenas keep theirs. */
+#define SLAB_MAGIC 0x51ab0bee
+
+/* Alignment of objects. */
+#define SLAB_ALIGN 8
+
+/* Slab header, at the start of each slab page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in a cache's slab list. */
+	size_t in_use;              /* # of allocated objects. */
+	int free_head;              /* First free object, or -1. */
+	uint8_t *objs;              /* First object. */
+	uint16_t next[];            /* Free object that follows each one. */
+};
+
+/* Object cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t size;                /* Object size, rounded up. */
+	size_t stride;              /* Distance between objects. */
+	size_t objs_per_slab;       /* # of objects in a slab. */
+	kmem_ctor *ctor;            /* Constructor, or null. */
+	struct lock lock;           /* Protects the members below. */
+	struct list partial;        /* Slabs with some objects free. */
+	struct list full;           /* Slabs with no objects free. */
+	struct list empty;          /* Slabs with all objects free. */
+	size_t slab_cnt;            /* # of slabs on all lists. */
+
+	/* Statistics. */
+	unsigned long long allocs;  /* # of objects allocated. */
+	unsigned long long frees;   /* # of objects freed. */
+	unsigned long long reclaimed; /* # of slabs given back. */
+
+	struct list_elem elem;      /* Element in cache_list. */
+};
+
+/* All caches.  Caches are never destroyed. */
+static struct list cache_list;
+
+static struct slab *slab_create (struct kmem_cache *);
+static size_t release_empty (struct kmem_cache *);
+static void *cache_alloc (struct kmem_cache *, const void *caller);
+
+/* Initializes the slab allocator. */
+void
+kmem_init (void) {
+	list_init (&cache_list);
+}
+
+/* Creates and returns a cache named NAME of objects of SIZE bytes,
+   which are constructed by CTOR if it is nonnull.  NAME must stay
+   valid forever.  Returns a null pointer if memory is not
+   available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor) {
+	struct kmem_cache *c;
+	size_t stride, n;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+
+	size = ROUND_UP (size, SLAB_ALIGN);
+	stride = size;
+#ifdef MEMTRACK
+	stride += ROUND_UP (sizeof (struct memtrack_tag), SLAB_ALIGN);
+#endif
+
+	/* Fit as many objects as the page holds after the header and
+	   the free-list links. */
+	n = (PGSIZE - sizeof (struct slab)) / (stride + sizeof (uint16_t));
+	while (n > 0 && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+				SLAB_ALIGN) + n * stride > PGSIZE)
+		n--;
+	ASSERT (n > 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		return NULL;
+	c->name = name;
+	c->size = size;
+	c->stride = stride;
+	c->objs_per_slab = n;
+	c->ctor = ctor;
+	lock_init (&c->lock);
+	lock_set_name (&c->lock, name);
+	list_init (&c->partial);
+	list_init (&c->full);
+	list_init (&c->empty);
+	c->slab_cnt = 0;
+	c->allocs = c->frees = c->reclaimed = 0;
+
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&cache_list, &c->elem);
+	intr_set_level (old_level);
+
+	return c;
+}
+
+/* Allocates an object from cache C and returns it, constructed if
+   C has a constructor.  Returns a null pointer if memory is not
+   available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	return cache_alloc (c, MEMTRACK_CALLER);
+}
+
+/* Does kmem_cache_alloc() on behalf of the function at CALLER. */
+static void *
+cache_alloc (struct kmem_cache *c, const void *caller UNUSED) {
+	struct slab *s;
+	uint8_t *obj;
+	int idx;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+	if (!list_empty (&c->partial))
+		s = list_entry (list_pop_front (&c->partial), struct slab, elem);
+	else if (!list_empty (&c->empty))
+		s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+	else {
+		s = slab_create (c);
+		if (s == NULL) {
+			lock_release (&c->lock);
+			return NULL;
+		}
+		c->slab_cnt++;
+	}
+
+	idx = s->free_head;
+	ASSERT (idx >= 0);
+	s->free_head = s->next[idx] != UINT16_MAX ? s->next[idx] : -1;
+	s->in_use++;
+	list_push_front (s->free_head < 0 ? &c->full : &c->partial, &s->elem);
+	c->allocs++;
+	lock_release (&c->lock);
+
+	obj = s->objs + c->stride * idx;
+#ifdef MEMTRACK
+	memtrack_alloc ((struct memtrack_tag *) (obj + c->size), MEMTRACK_SLAB,
+			caller, c->size, c->size);
+#endif
+	return obj;
+}
+
+/* Allocates a zeroed object from cache C, which must not have a
+   constructor.  Returns a null pointer if memory is not
+   available. */
+void *
+kmem_cache_zalloc (struct kmem_cache *c) {
+	void *obj;
+
+	ASSERT (c != NULL);
+	ASSERT (c->ctor == NULL);
+
+	obj = cache_alloc (c, MEMTRACK_CALLER);
+	if (obj != NULL)
+		memset (obj, 0, c->size);
+	return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C.  A null
+   OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+	size_t ofs;
+	int idx;
+
+	if (obj == NULL)
+		return;
+
+	s = pg_round_down (obj);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == c);
+	ofs = (uint8_t *) obj - s->objs;
+	ASSERT (ofs % c->stride == 0);
+	idx = ofs / c->stride;
+
+#ifdef MEMTRACK
+	memtrack_free ((struct memtrack_tag *) ((uint8_t *) obj + c->size));
+#endif
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless
+	   it must keep its constructed state. */
+	if (c->ctor == NULL)
+		memset (obj, 0xcc, c->size);
+#endif
+
+	lock_acquire (&c->lock);
+	list_remove (&s->elem);
+	s->next[idx] = s->free_head >= 0 ? s->free_head : UINT16_MAX;
+	s->free_head = idx;
+	s->in_use--;
+	list_push_front (s->in_use == 0 ? &c->empty : &c->partial, &s->elem);
+	c->frees++;
+	lock_release (&c->lock);
+}
+
+/* Gives the empty slabs of cache C back to the page allocator and
+   returns how many there were. */
+size_t
+kmem_cache_shrink (struct kmem_cache *c) {
+	size_t cnt;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+	cnt = release_empty (c);
+	lock_release (&c->lock);
+	return cnt;
+}
+
+/* Returns true if P points into a slab, that is, if it was
+   allocated by kmem_cache_alloc(). */
+bool
+kmem_owns (const void *p) {
+	const struct slab *s = pg_round_down (p);
+
+	return p != NULL && s->magic == SLAB_MAGIC;
+}
+
+/* Frees OBJ, allocated from whichever cache. */
+void
+kmem_free (void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	ASSERT (kmem_owns (obj));
+	kmem_cache_free (s->cache, obj);
+}
+
+/* Gives the empty slabs of every cache back to the page allocator
+   and returns how many there were.  Called when memory runs low,
+   possibly while the current thread holds some cache's lock, so
+   caches whose lock is not free right away are skipped. */
+size_t
+kmem_reclaim (void) {
+	struct list_elem *e;
+	size_t cnt = 0;
+
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		if (lock_held_by_current_thread (&c->lock)
+				|| !lock_try_acquire (&c->lock))
+			continue;
+		cnt += release_empty (c);
+		lock_release (&c->lock);
+	}
+	return cnt;
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		printf ("Slab %s: %zu-byte objects, %llu in use, %zu slabs "
+				"(%zu empty), %llu allocs, %llu frees, %llu reclaimed\n",
+				c->name, c->size, c->allocs - c->frees, c->slab_cnt,
+				list_size (&c->empty), c->allocs, c->frees, c->reclaimed);
+	}
+}
+
+/* Allocates a page for a new slab of cache C, whose lock must be
+   held, and constructs its objects.  Returns a null pointer if
+   memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c) {
+	struct slab *s;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&c->lock));
+
+	s = palloc_get_page (0);
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->in_use = 0;
+	s->free_head = 0;
+	s->objs = (uint8_t *) s + ROUND_UP (sizeof *s
+			+ c->objs_per_slab * sizeof *s->next, SLAB_ALIGN);
+	for (i = 0; i < c->objs_per_slab; i++) {
+		s->next[i] = i + 1 < c->objs_per_slab ? i + 1 : UINT16_MAX;
+		if (c->ctor != NULL)
+			c->ctor (s->objs + c->stride * i);
+	}
+	return s;
+}
+
+/* Frees the empty slabs of cache C, whose lock must be held, and
+   returns how many there were. */
+static size_t
+release_empty (struct kmem_cache *c) {
+	size_t cnt = 0;
+
+	ASSERT (lock_held_by_current_thread (&c->lock));
+
+	while (!list_empty (&c->empty)) {
+		struct slab *s = list_entry (list_pop_front (&c->empty),
+				struct slab, elem);
+
+		s->magic = 0;
+		palloc_free_page (s);
+		cnt++;
+	}
+	c->slab_cnt -= cnt;
+	c->reclaimed += cnt;
+	return cnt;
+}
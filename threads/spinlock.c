@@ -0,0 +1,49 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Initializes spin lock L, named NAME. */
+void
+spinlock_init (struct spinlock *l, const char *name) {
+	ASSERT (l != NULL);
+
+	l->locked = 0;
+	l->name = name;
+	l->stat = lock_stat_lookup (name);
+}
+
+/* Acquires L, busy-waiting until it is free.  Interrupts must be
+ * off and L must not already be held. */
+void
+spin_lock (struct spinlock *l) {
+	bool contended = false;
+
+	ASSERT (l != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spin_lock_held (l));
+
+	while (__atomic_exchange_n (&l->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+		contended = true;
+		while (l->locked)
+			asm volatile ("pause");
+	}
+	lock_stat_spin (l->stat, contended);
+}
+
+/* Releases L, which must be held. */
+void
+spin_unlock (struct spinlock *l) {
+	ASSERT (l != NULL);
+	ASSERT (spin_lock_held (l));
+
+	__atomic_store_n (&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns true if L is held.  With one CPU and interrupts off,
+ * the holder can only be the caller. */
+bool
+spin_lock_held (const struct spinlock *l) {
+	return l->locked != 0;
+}
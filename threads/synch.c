@@ -31,6 +31,44 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+/* If true, named locks and semaphores record contention
+   statistics.  Controlled by kernel command-line option
+   "-lockstat". */
+bool lock_profiling;
+
+/* Contention statistics of all the locks and semaphores that
+   share a name.  Locks made on the fly, such as each inode's,
+   share one entry, so the table stays small and entries are
+   never freed.  Spin locks are recorded here too, but as they
+   never sleep and are held with interrupts off, only their
+   acquisitions and contended acquisitions are counted. */
+struct lock_stat {
+	const char* name;
+	unsigned long long acquired;        /* # of acquisitions. */
+	unsigned long long contended;       /* # of them that had to wait. */
+	int64_t wait_ticks;                 /* Total ticks spent waiting. */
+	int64_t max_wait_ticks;             /* Longest wait. */
+	int64_t hold_ticks;                 /* Total ticks held (locks only). */
+	int64_t max_hold_ticks;             /* Longest hold. */
+	unsigned long long donations;       /* # of donations to a holder. */
+};
+
+#define LOCK_STAT_MAX 32
+static struct lock_stat lock_stats[LOCK_STAT_MAX];
+static size_t lock_stat_cnt;
+static unsigned long long lock_donations; /* # of donations, any lock. */
+
+/* sema_down()이 waiters에 넣은 순서.  우선순위가 같은 스레드는
+   먼저 기다린 쪽이 먼저 깨어난다. */
+static uint64_t next_wait_seq;
+
+static bool thread_compare_waiter(const struct heap_elem* a,
+	const struct heap_elem* b, void* aux UNUSED);
+static int lock_donation(const struct lock*);
+static int effective_priority(struct thread*);
+static void waiter_push(struct semaphore*, struct thread*);
 
 			/* Initializes semaphore SEMA to VALUE.  A semaphore is a
 					nonnegative integer along with two atomic operators for
@@ -47,7 +85,19 @@ sema_init(struct semaphore* sema, unsigned value) {
 	ASSERT(sema != NULL);
 
 	sema->value = value;
-	list_init(&sema->waiters);
+	heap_init(&sema->waiters, thread_compare_waiter, NULL);
+	sema->stat = NULL;
+}
+
+/* Names SEMA, so that its contention is recorded under NAME when
+	 lock_profiling is on.  NAME must stay valid forever; a string
+	 literal is the usual choice. */
+void
+sema_set_name(struct semaphore* sema, const char* name) {
+	ASSERT(sema != NULL);
+	ASSERT(name != NULL);
+
+	sema->stat = lock_stat_lookup(name);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -61,17 +111,33 @@ sema_init(struct semaphore* sema, unsigned value) {
 void
 sema_down(struct semaphore* sema) {
 	enum intr_level old_level;
+	struct lock_stat* stat;
+	int64_t wait_start = -1;
 
 	ASSERT(sema != NULL);
 	ASSERT(!intr_context());
 
+	stat = lock_profiling ? sema->stat : NULL;
 	old_level = intr_disable();
+	if (stat != NULL && sema->value == 0)
+		wait_start = timer_ticks();
 	while (sema->value == 0) {
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, thread_compare_priority, NULL);
+		waiter_push(sema, thread_current());
 		thread_block();
 	}
 
 	sema->value--;
+	if (stat != NULL) {
+		stat->acquired++;
+		if (wait_start >= 0) {
+			int64_t wait = timer_ticks() - wait_start;
+
+			stat->contended++;
+			stat->wait_ticks += wait;
+			if (wait > stat->max_wait_ticks)
+				stat->max_wait_ticks = wait;
+		}
+	}
 	intr_set_level(old_level);
 }
 
@@ -92,6 +158,8 @@ sema_try_down(struct semaphore* sema) {
 	{
 		sema->value--;
 		success = true;
+		if (lock_profiling && sema->stat != NULL)
+			sema->stat->acquired++;
 	}
 	else
 		success = false;
@@ -102,23 +170,31 @@ sema_try_down(struct semaphore* sema) {
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
 	 and wakes up one thread of those waiting for SEMA, if any.
+	 Outside interrupt context, a woken thread that should run
+	 now gets the CPU directly through thread_yield_to().
 
 	 This function may be called from an interrupt handler. */
 void
 sema_up(struct semaphore* sema) {
 	enum intr_level old_level;
+	struct thread* t = NULL;
 
 	ASSERT(sema != NULL);
 
 	old_level = intr_disable();
-	if (!list_empty(&sema->waiters)) {
-		list_sort(&sema->waiters, thread_compare_priority, NULL);
-		thread_unblock(list_entry(list_pop_front(&sema->waiters),
-			struct thread, elem));
+	if (!heap_empty(&sema->waiters)) {
+		t = heap_entry(heap_pop(&sema->waiters), struct thread, waiter_elem);
+		t->wait_sema = NULL;
 	}
 	sema->value++;
 
-	thread_test_preemption();
+	if (t != NULL && !intr_context())
+		thread_yield_to(t);
+	else {
+		if (t != NULL)
+			thread_unblock(t);
+		thread_test_preemption();
+	}
 	intr_set_level(old_level);
 }
 
@@ -180,30 +256,147 @@ lock_init(struct lock* lock) {
 	sema_init(&lock->semaphore, 1);
 }
 
-bool thread_compare_donate_priority(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED)
-{
-	struct thread* data_a = list_entry(a, struct thread, donation_elem);
-	struct thread* data_b = list_entry(b, struct thread, donation_elem);
-	return data_a->priority > data_b->priority;
+/* Names LOCK for lock profiling.  See sema_set_name(). */
+void
+lock_set_name(struct lock* lock, const char* name) {
+	ASSERT(lock != NULL);
+
+	sema_set_name(&lock->semaphore, name);
 }
 
-void donate_priority(void) {
-	// 'sema - waiters' 대기열에 들어가기 전에 우선순위 donation
-	struct thread* curr = thread_current();
+/* 세마포어 waiters 정렬 기준: 우선순위가 높은 스레드가 먼저,
+   같으면 먼저 기다린 스레드가 먼저. */
+static bool
+thread_compare_waiter(const struct heap_elem* a, const struct heap_elem* b,
+	void* aux UNUSED) {
+	const struct thread* ta = heap_entry(a, struct thread, waiter_elem);
+	const struct thread* tb = heap_entry(b, struct thread, waiter_elem);
 
-	// holder에게 우선순위 부여(중첩 고려)
-	while (curr->wait_on_lock != NULL) {
-		struct thread* holder = curr->wait_on_lock->holder;
+	if (ta->priority != tb->priority)
+		return ta->priority > tb->priority;
+	return ta->wait_seq < tb->wait_seq;
+}
 
-		if (curr->priority > holder->priority) {
-			holder->priority = curr->priority;
-			curr = holder;
-		}
-		else {
-			break;
+/* Returns the priority LOCK donates to its holder: that of the
+	 highest-priority thread waiting for it, or PRI_MIN - 1 if
+	 nobody is waiting. */
+static int
+lock_donation(const struct lock* lock) {
+	struct heap_elem* top = heap_top(&lock->semaphore.waiters);
+
+	if (top == NULL)
+		return PRI_MIN - 1;
+	return heap_entry(top, struct thread, waiter_elem)->priority;
+}
+
+/* held_locks 정렬 기준: 가장 큰 우선순위를 기부하는 lock이 먼저.
+   lock의 키는 waiters의 top이므로, waiters를 바꾸기 전에 lock을
+   holder의 held_locks에서 빼고, 바꾼 뒤 다시 넣어야 한다. */
+bool
+lock_compare_donation(const struct heap_elem* a, const struct heap_elem* b,
+	void* aux UNUSED) {
+	return lock_donation(heap_entry(a, struct lock, holder_elem))
+		> lock_donation(heap_entry(b, struct lock, holder_elem));
+}
+
+/* Returns T's priority once donations are taken into account:
+	 the larger of its own priority and the best priority donated
+	 through any lock it holds.  held_locks is a heap, so this is
+	 O(1) no matter how many locks or waiters T has. */
+static int
+effective_priority(struct thread* t) {
+	int priority = t->original_priority;
+
+	if (!thread_mlfqs && !heap_empty(&t->held_locks)) {
+		int donated = lock_donation(heap_entry(heap_top(&t->held_locks),
+			struct lock, holder_elem));
+		if (donated > priority)
+			priority = donated;
+	}
+	return priority;
+}
+
+/* Returns the holder of the lock T is waiting for, if T is
+	 waiting for it on SEMA, or a null pointer.  Only such a lock
+	 has to be re-keyed when SEMA's waiters change. */
+static struct thread*
+waited_lock_holder(struct semaphore* sema, struct thread* t) {
+	struct lock* lock = t->wait_on_lock;
+
+	if (lock == NULL || &lock->semaphore != sema)
+		return NULL;
+	return lock->holder;
+}
+
+/* Adds T to SEMA's waiters.  If SEMA belongs to a lock T is
+	 acquiring, the lock's holder may now get a higher donation, so
+	 propagate it down the chain. */
+static void
+waiter_push(struct semaphore* sema, struct thread* t) {
+	struct thread* holder = waited_lock_holder(sema, t);
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	t->wait_seq = next_wait_seq++;
+	t->wait_sema = sema;
+	if (holder == NULL) {
+		heap_push(&sema->waiters, &t->waiter_elem);
+		return;
+	}
+
+	heap_remove(&holder->held_locks, &t->wait_on_lock->holder_elem);
+	heap_push(&sema->waiters, &t->waiter_elem);
+	heap_push(&holder->held_locks, &t->wait_on_lock->holder_elem);
+	if (thread_mlfqs)
+		return;
+
+	if (lock_profiling && t->priority > holder->priority) {
+		lock_donations++;
+		if (sema->stat != NULL)
+			sema->stat->donations++;
+	}
+	priority_update(holder, effective_priority(holder));
+}
+
+/* Sets T's priority to PRIORITY and keeps every structure ordered
+	 by it consistent: T's ready queue, the waiters heap T is
+	 blocked on, and, if that is a lock, the holder's held_locks.
+	 The new donation then flows to the holder, and on to whatever
+	 lock the holder is waiting for, for as long as the chain goes.
+	 The walk is a loop rather than recursion, so there is no cap on
+	 chain depth.  Must be called with interrupts off. */
+void
+priority_update(struct thread* t, int priority) {
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	while (t->priority != priority) {
+		struct semaphore* sema = t->wait_sema;
+		struct thread* holder;
+
+		if (sema == NULL) {
+			thread_change_priority(t, priority);
+			return;
 		}
+
+		/* T의 키가 바뀌므로 T를 waiters에서 뺐다가 다시 넣는다. */
+		holder = waited_lock_holder(sema, t);
+		if (holder != NULL)
+			heap_remove(&holder->held_locks, &t->wait_on_lock->holder_elem);
+		heap_remove(&sema->waiters, &t->waiter_elem);
+		t->priority = priority;
+		heap_push(&sema->waiters, &t->waiter_elem);
+		if (holder == NULL)
+			return;
+		heap_push(&holder->held_locks, &t->wait_on_lock->holder_elem);
+
+		/* mlfqs에서는 우선순위 기부를 하지 않는다. */
+		if (thread_mlfqs)
+			return;
+		t = holder;
+		priority = effective_priority(holder);
 	}
 }
+
 /* Acquires LOCK, sleeping until it becomes available if
 	 necessary.  The lock must not already be held by the current
 	 thread.
@@ -214,28 +407,30 @@ void donate_priority(void) {
 	 we need to sleep. */
 void
 lock_acquire(struct lock* lock) {
+	enum intr_level old_level;
+
 	ASSERT(lock != NULL);
 	ASSERT(!intr_context());
 	ASSERT(!lock_held_by_current_thread(lock));
 
 	struct thread* curr = thread_current();
 
-	/* lock을 가진 스레드가 있다면 우선순위 기부 후, 대기 */
-	if (lock->holder) {
-		// holder의 donations에 현재 스레드 추가
-		list_insert_ordered(&lock->holder->donations, &curr->donation_elem, thread_compare_donate_priority, NULL);
-
-		// 현재 스레드가 실제로 기다리는 lock 추가
-		curr->wait_on_lock = lock;
-
-		// 현재 스레드의 우선순위보다 낮은 중첩 스레드에게 우선순위 기부
-		donate_priority();
-	}
+	/* wait_on_lock을 세워 두면 sema_down()이 waiters에 들어갈 때
+	   holder에게 우선순위를 기부한다(중첩 포함). */
+	old_level = intr_disable();
+	curr->wait_on_lock = lock;
 	sema_down(&lock->semaphore);
 
-	/* lock을 가질 순서가 되면, lock을 가진다. */
+	/* lock을 가질 순서가 되면, lock을 가진다.  남은 waiters의
+	   우선순위는 이제 현재 스레드가 기부받는다. */
 	curr->wait_on_lock = NULL;
 	lock->holder = curr;
+	if (lock_profiling)
+		lock->acquired_at = timer_ticks();
+	heap_push(&curr->held_locks, &lock->holder_elem);
+	if (!thread_mlfqs)
+		priority_update(curr, effective_priority(curr));
+	intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -246,48 +441,31 @@ lock_acquire(struct lock* lock) {
 	 interrupt handler. */
 bool
 lock_try_acquire(struct lock* lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT(lock != NULL);
 	ASSERT(!lock_held_by_current_thread(lock));
 
+	old_level = intr_disable();
 	success = sema_try_down(&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current();
-	return success;
-}
-
-void remove_with_lock(struct lock* lock) {
-	// lock을 release 하는 시점에 해당 lock으로 나를 기다렸던 스레드의 우선순위 반환
-	// (각자 다른 lock으로 나를 기다릴 수 있기 때문에(다중), 해당 lock을 가진 thread만 삭제)
-
-	struct thread* curr = thread_current();
-	struct list_elem* d_elem = list_begin(&curr->donations);
-
-	while (d_elem != list_end(&curr->donations)) {
-		struct thread* t = list_entry(d_elem, struct thread, donation_elem);
-		if (lock == t->wait_on_lock) {
-			list_remove(&t->donation_elem); // 이제 관련 없는 스레드는 지워줌
-		}
-		d_elem = list_next(d_elem);
+		if (lock_profiling)
+			lock->acquired_at = timer_ticks();
+		heap_push(&lock->holder->held_locks, &lock->holder_elem);
 	}
+	intr_set_level(old_level);
+	return success;
 }
 
 void refresh_priority(void) {
-	// 내가 가진 donations 중에 가장 높은 우선순위를 기부받음
+	// 내가 가진 lock들 중 가장 높은 기부 우선순위를 반영
 	struct thread* curr = thread_current();
-	curr->priority = curr->original_priority;
+	enum intr_level old_level = intr_disable();
 
-	if (list_empty(&curr->donations)) {
-		return;
-	}
-
-	list_sort(&curr->donations, thread_compare_donate_priority, NULL);
-
-	struct thread* max_thread = list_entry(list_front(&curr->donations), struct thread, donation_elem);
-	if (max_thread->priority > curr->priority) {
-		curr->priority = max_thread->priority;
-	}
+	priority_update(curr, effective_priority(curr));
+	intr_set_level(old_level);
 }
 
 /* Releases LOCK, which must be owned by the current thread.
@@ -298,18 +476,87 @@ void refresh_priority(void) {
 	 handler. */
 void
 lock_release(struct lock* lock) {
+	enum intr_level old_level;
+
 	ASSERT(lock != NULL);
 	ASSERT(lock_held_by_current_thread(lock));
 
-	/* 해당 lock으로 기부받은 우선순위 삭제(중첩 처리) */
-	remove_with_lock(lock);
+	struct thread* curr = thread_current();
+
+	old_level = intr_disable();
+	if (lock_profiling && lock->semaphore.stat != NULL) {
+		struct lock_stat* stat = lock->semaphore.stat;
+		int64_t hold = timer_ticks() - lock->acquired_at;
 
-	/* 현재 스레드 우선순위 재계산 */
-	refresh_priority();
+		stat->hold_ticks += hold;
+		if (hold > stat->max_hold_ticks)
+			stat->max_hold_ticks = hold;
+	}
 
-	/* lock을 해제함 */
+	/* 해당 lock으로 기부받은 우선순위 삭제 후 재계산(중첩 처리) */
+	heap_remove(&curr->held_locks, &lock->holder_elem);
 	lock->holder = NULL;
+	if (!thread_mlfqs)
+		priority_update(curr, effective_priority(curr));
+
+	/* lock을 해제함 */
 	sema_up(&lock->semaphore);
+	intr_set_level(old_level);
+}
+
+/* Returns the statistics entry for NAME, creating it if needed,
+	 or a null pointer if the table is full. */
+struct lock_stat*
+lock_stat_lookup(const char* name) {
+	struct lock_stat* stat = NULL;
+	enum intr_level old_level = intr_disable();
+	size_t i;
+
+	for (i = 0; i < lock_stat_cnt; i++)
+		if (!strcmp(lock_stats[i].name, name)) {
+			stat = &lock_stats[i];
+			break;
+		}
+	if (stat == NULL && lock_stat_cnt < LOCK_STAT_MAX) {
+		stat = &lock_stats[lock_stat_cnt++];
+		stat->name = name;
+	}
+	intr_set_level(old_level);
+
+	return stat;
+}
+
+/* Records an acquisition of a spin lock whose statistics are STAT,
+	 which may be null, and whether it found the lock held.  Called
+	 with the spin lock held. */
+void
+lock_stat_spin(struct lock_stat* stat, bool contended) {
+	if (!lock_profiling || stat == NULL)
+		return;
+	stat->acquired++;
+	if (contended)
+		stat->contended++;
+}
+
+/* Prints lock contention statistics, if lock_profiling is on. */
+void
+lock_print_stats(void) {
+	size_t i;
+
+	if (!lock_profiling)
+		return;
+
+	printf("Locks: %llu priority donations\n", lock_donations);
+	for (i = 0; i < lock_stat_cnt; i++) {
+		const struct lock_stat* s = &lock_stats[i];
+
+		printf("  %-14s %llu acquired, %llu contended, "
+			"wait %lld/%lld ticks, hold %lld/%lld ticks (total/max), "
+			"%llu donations\n",
+			s->name, s->acquired, s->contended,
+			s->wait_ticks, s->max_wait_ticks,
+			s->hold_ticks, s->max_hold_ticks, s->donations);
+	}
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -322,13 +569,17 @@ lock_held_by_current_thread(const struct lock* lock) {
 	return lock->holder == thread_current();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a heap. */
 struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
+	struct heap_elem elem;              /* Heap element. */
 	struct semaphore semaphore;         /* This semaphore. */
-	int priority;
+	int priority;                       /* Waiter's priority at cond_wait(). */
+	uint64_t seq;                       /* FIFO order among equals. */
 };
 
+static bool sema_compare_priority(const struct heap_elem* a,
+	const struct heap_elem* b, void* aux UNUSED);
+
 /* Initializes condition variable COND.  A condition variable
 	 allows one piece of code to signal a condition and cooperating
 	 code to receive the signal and act upon it. */
@@ -336,7 +587,7 @@ void
 cond_init(struct condition* cond) {
 	ASSERT(cond != NULL);
 
-	list_init(&cond->waiters);
+	heap_init(&cond->waiters, sema_compare_priority, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -359,12 +610,15 @@ cond_init(struct condition* cond) {
 	 interrupt handler.  This function may be called with
 	 interrupts disabled, but interrupts will be turned back on if
 	 we need to sleep. */
-bool sema_compare_priority(const struct list_elem* a, const struct list_elem* b,
+static bool
+sema_compare_priority(const struct heap_elem* a, const struct heap_elem* b,
 	void* aux UNUSED) {
-	struct semaphore_elem* sema_a = list_entry(a, struct semaphore_elem, elem);
-	struct semaphore_elem* sema_b = list_entry(b, struct semaphore_elem, elem);
+	struct semaphore_elem* sema_a = heap_entry(a, struct semaphore_elem, elem);
+	struct semaphore_elem* sema_b = heap_entry(b, struct semaphore_elem, elem);
 
-	return sema_a->priority > sema_b->priority;
+	if (sema_a->priority != sema_b->priority)
+		return sema_a->priority > sema_b->priority;
+	return sema_a->seq < sema_b->seq;
 }
 
 void
@@ -378,8 +632,8 @@ cond_wait(struct condition* cond, struct lock* lock) {
 	ASSERT(lock_held_by_current_thread(lock));
 
 	sema_init(&waiter.semaphore, 0);
-	list_push_back(&cond->waiters, &waiter.elem);
-	// list_insert_ordered(&cond->waiters, &waiter.elem, sema_compare_priority, NULL);
+	waiter.seq = next_wait_seq++;
+	heap_push(&cond->waiters, &waiter.elem);
 
 	lock_release(lock);
 	sema_down(&waiter.semaphore);
@@ -408,13 +662,9 @@ cond_signal(struct condition* cond, struct lock* lock UNUSED) {
 	ASSERT(!intr_context());
 	ASSERT(lock_held_by_current_thread(lock));
 
-	if (!list_empty(&cond->waiters))
-	{
-		list_sort(&cond->waiters, sema_compare_priority, NULL);
-
-		sema_up(&list_entry(list_pop_front(&cond->waiters),
+	if (!heap_empty(&cond->waiters))
+		sema_up(&heap_entry(heap_pop(&cond->waiters),
 			struct semaphore_elem, elem)->semaphore);
-	}
 }
 /* Wakes up all threads, if any, waiting on COND (protected by
 	 LOCK).  LOCK must be held before calling this function.
@@ -427,6 +677,6 @@ cond_broadcast(struct condition* cond, struct lock* lock) {
 	ASSERT(cond != NULL);
 	ASSERT(lock != NULL);
 
-	while (!list_empty(&cond->waiters))
+	while (!heap_empty(&cond->waiters))
 		cond_signal(cond, lock);
 }
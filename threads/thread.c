@@ -12,6 +12,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/malloc.h"
+#include "threads/memtrack.h"
+#include "threads/slab.h"
+#include "threads/fixed-point.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -26,9 +30,30 @@
      Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-     /* List of processes in THREAD_READY state, that is, processes
-         that are ready to run but not actually running. */
-static struct list ready_list;
+     /* Run queue: lists of processes in THREAD_READY state,
+         that is, processes that are ready to run but not actually
+         running.  There is one FIFO queue per priority, and bit P of
+         BITMAP is set iff QUEUES[P] is nonempty, so the highest
+         runnable priority is found with a single bit scan.
+
+         Under the fair-share scheduler the queues are unused and
+         ready threads sit in CFS_TREE instead, ordered by vruntime. */
+struct runqueue {
+  struct list queues[PRI_MAX + 1];
+  uint64_t bitmap;
+  struct rb_tree cfs_tree;        /* Ready threads by vruntime. */
+  uint64_t min_vruntime;          /* Never decreasing vruntime floor. */
+  unsigned long cfs_load;         /* Sum of cfs_weight in CFS_TREE. */
+  size_t cnt;                     /* # of ready threads. */
+};
+
+/* The run queue.  Protected by disabling interrupts, like the
+   rest of the scheduler's state. */
+static struct runqueue runqueue;
+
+/* List of all processes.  Processes are added to this list
+   when they are created and removed when they exit. */
+static struct list all_list;
 
 /* Idle thread. */
 static struct thread* idle_thread;
@@ -42,6 +67,18 @@ static struct lock tid_lock;
 /* Thread destruction requests */
 static struct list destruction_req;
 
+/* Pages of dead threads kept for reuse by thread_create(), so
+   that fork/exit-heavy loads do not go through the page
+   allocator's bitmap and zero a whole page for each thread.
+   init_thread() clears the struct thread, and the rest of the
+   page is stack, which needs no zeroing.  Protected by disabling
+   interrupts. */
+#define THREAD_CACHE_MAX 16     /* Max # of pages in thread_cache. */
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;   /* # of creations served from cache. */
+static long long thread_cache_misses; /* # of creations from palloc. */
+
 /* Statistics. */
 static long long idle_ticks;   /* # of timer ticks spent idle. */
 static long long kernel_ticks; /* # of timer ticks in kernel threads. */
@@ -50,20 +87,87 @@ static long long user_ticks;   /* # of timer ticks in user programs. */
 /* Scheduling. */
 #define TIME_SLICE 4          /* # of timer ticks to give each thread. */
 static unsigned thread_ticks; /* # of timer ticks since last yield. */
+static unsigned time_slice = TIME_SLICE; /* # of ticks for the running thread. */
 
 /* If false (default), use round-robin scheduler.
 If true, use multi-level feedback queue
 scheduler. Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* 4.4BSD scheduler state. */
+#define MLFQS_PRIORITY_PERIOD 4 /* # of ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+
+/* Threads whose recent_cpu changed since the last priority
+   update.  Only these need their priority recomputed on the
+   ticks between the once-per-second full recomputation, so
+   that work does not grow with the number of threads. */
+static struct list mlfqs_dirty_list;
+
+/* If true, use the fair-share scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+/* Object caches for struct child_status and struct fd_table. */
+struct kmem_cache* child_status_cache;
+struct kmem_cache* fd_table_cache;
+
+/* Fair-share scheduler.  A thread's vruntime grows by
+   CFS_TICK_NSEC * NICE_0_WEIGHT / weight for every tick it runs,
+   and the ready thread with the least vruntime runs next, so CPU
+   time is shared in proportion to weight.  Every ready thread
+   gets a turn within CFS_LATENCY ticks, unless there are so many
+   that slices would be shorter than CFS_MIN_GRANULARITY. */
+#define CFS_LATENCY 8                 /* Target latency, in ticks. */
+#define CFS_MIN_GRANULARITY 1         /* Shortest slice, in ticks. */
+#define CFS_TICK_NSEC (1000000000ULL / TIMER_FREQ)
+#define CFS_WAKEUP_GRAN CFS_TICK_NSEC /* vruntime lead to preempt. */
+#define CFS_SLEEPER_CREDIT (CFS_LATENCY * CFS_TICK_NSEC / 2)
+#define NICE_0_WEIGHT 1024
+
+/* Weight of each nice value from NICE_MIN to NICE_MAX.  Each step
+   is about 1.25x, so one nice level is worth about 10% of CPU
+   time against a competing thread. */
+static const unsigned cfs_nice_weight[NICE_MAX - NICE_MIN + 1] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */ 9548, 7620, 6100, 4904, 3906,
+  /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+  /*   0 */ 1024, 820, 655, 526, 423,
+  /*   5 */ 335, 272, 215, 172, 137,
+  /*  10 */ 110, 87, 70, 56, 45,
+  /*  15 */ 36, 29, 23, 18, 15,
+  /*  20 */ 12,
+};
+
 static void kernel_thread(thread_func*, void* aux);
 
 static void idle(void* aux UNUSED);
 static struct thread* next_thread_to_run(void);
 static void init_thread(struct thread*, const char* name, int priority);
 static void do_schedule(int status);
+static void do_schedule_to(int status, struct thread* next);
 static void schedule(void);
+static void schedule_to(struct thread* next);
 static tid_t allocate_tid(void);
+static struct thread* thread_page_alloc(void);
+static void thread_page_free(struct thread*);
+static void ready_queue_push(struct thread*);
+static struct thread* ready_queue_pop(struct runqueue*);
+static void ready_queue_remove(struct thread*);
+static int ready_queue_top_priority(const struct runqueue*);
+static void mlfqs_tick(struct thread*);
+static void mlfqs_update_priority(struct thread*);
+static void mlfqs_update_recent_cpu(struct thread*);
+static void mlfqs_update_load_avg(void);
+static void runqueue_add(struct runqueue*, struct thread*);
+static void runqueue_del(struct runqueue*, struct thread*);
+static bool cfs_less(const struct rb_node*, const struct rb_node*, void* aux);
+static unsigned cfs_weight(const struct thread*);
+static void cfs_tick(struct thread*);
+static void cfs_place(struct thread*);
+static bool cfs_preempts(struct runqueue*, struct thread*);
+static unsigned cfs_slice(struct runqueue*, struct thread*);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -108,8 +212,18 @@ thread_init(void) {
 
   /* Init the globla thread context */
   lock_init(&tid_lock);
-  list_init(&ready_list);
+  lock_set_name(&tid_lock, "tid_lock");
+  for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init(&runqueue.queues[pri]);
+  runqueue.bitmap = 0;
+  rb_init(&runqueue.cfs_tree, cfs_less, NULL);
+  runqueue.min_vruntime = 0;
+  runqueue.cfs_load = 0;
+  runqueue.cnt = 0;
+  list_init(&all_list);
+  list_init(&mlfqs_dirty_list);
   list_init(&destruction_req);
+  list_init(&thread_cache);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread();
@@ -123,6 +237,13 @@ thread_init(void) {
    Also creates the idle thread. */
 void
 thread_start(void) {
+  /* Every thread_create() from here on allocates from these. */
+  child_status_cache =
+    kmem_cache_create("child_status", sizeof(struct child_status), NULL);
+  fd_table_cache = kmem_cache_create("fd_table", sizeof(struct fd_table), NULL);
+  if (child_status_cache == NULL || fd_table_cache == NULL)
+    PANIC("thread_start: out of memory");
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init(&idle_started, 0);
@@ -151,8 +272,16 @@ thread_tick(void) {
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE){
+  if (thread_mlfqs)
+    mlfqs_tick(t);
+  else if (thread_cfs && t != idle_thread)
+    cfs_tick(t);
+
+  /* Enforce preemption.  The idle thread gives the CPU up by
+     itself once it wakes from hlt, and may be ticked outside of
+     the interrupt handler when the timer catches up after a
+     tickless sleep. */
+  if (t != idle_thread && ++thread_ticks >= time_slice){
     intr_yield_on_return();
   }
 }
@@ -162,26 +291,48 @@ void
 thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
     idle_ticks, kernel_ticks, user_ticks);
-}
-
-/* ready_list 우선순위 정렬을 위한 서브 함수 */
-bool thread_compare_priority(const struct list_elem* a, const struct list_elem* b,
-  void* aux UNUSED) {
-  struct thread* data_a = list_entry(a, struct thread, elem);
-  struct thread* data_b = list_entry(b, struct thread, elem);
-  return data_a->priority > data_b->priority;
+  printf("Thread cache: %lld hits, %lld misses, %zu pages cached\n",
+    thread_cache_hits, thread_cache_misses, thread_cache_cnt);
 }
 
 void
 thread_test_preemption(void)
 {
-  if (!list_empty(&ready_list) &&
-    thread_current()->priority <
-    list_entry(list_front(&ready_list), struct thread, elem)->priority)
+  struct thread* curr = thread_current();
+  bool preempt;
+
+  if (thread_cfs)
+    preempt = cfs_preempts(&runqueue, curr);
+  else
+    preempt = curr->priority < ready_queue_top_priority(&runqueue);
+
+  if (preempt)
     if(!intr_context())
       thread_yield();
 }
 
+/* Changes the effective priority of T to PRIORITY.  If T is
+   sitting in a ready queue it is moved to the queue for its new
+   priority, at the back, just as if it had become ready now. */
+void
+thread_change_priority(struct thread* t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT(is_thread(t));
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable();
+  if (t->status == THREAD_READY && t != idle_thread && t->priority != priority) {
+    ready_queue_remove(t);
+    t->priority = priority;
+    ready_queue_push(t);
+  }
+  else
+    t->priority = priority;
+  intr_set_level(old_level);
+}
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -207,13 +358,25 @@ thread_create(const char* name, int priority,
   ASSERT(function != NULL);
   
   /* Allocate thread. */
-  t = palloc_get_page(PAL_ZERO);
+  t = thread_page_alloc();
   if (t == NULL)
     return TID_ERROR;
   
   /* Initialize thread. */
   init_thread(t, name, priority);
   tid = t->tid = allocate_tid();
+
+  /* The 4.4BSD scheduler ignores PRIORITY: the child starts with
+     its parent's niceness and recent_cpu. */
+  if (thread_mlfqs) {
+    t->nice = thread_current()->nice;
+    t->recent_cpu = thread_current()->recent_cpu;
+    mlfqs_update_priority(t);
+  }
+
+  /* 새 스레드는 현재 가장 뒤처진 스레드와 같은 vruntime에서 시작한다. */
+  if (thread_cfs)
+    t->vruntime = runqueue.min_vruntime;
   
   /* child list init */
   lock_init(&t->childlist_lock);
@@ -223,7 +386,7 @@ thread_create(const char* name, int priority,
   // main에서 사용자 프로그램 실행할때만 예외적으로 자식프로세스 취급
   if(strcmp(thread_current()->name, "main") == 0 && strcmp(name, "idle") != 0){
 
-    struct child_status *ch_st = calloc(1, sizeof(struct child_status));
+    struct child_status *ch_st = kmem_cache_zalloc(child_status_cache);
 	  list_push_back(&thread_current()->child_list, &ch_st->elem);
     
     /* child_status 등록 */
@@ -241,8 +404,7 @@ thread_create(const char* name, int priority,
   t->isforked = false;
 
   /* file despriptor init */
-  t->fd_table = malloc(sizeof(struct fd_table));
-  memset(t->fd_table, 0, sizeof(struct fd_table));
+  t->fd_table = kmem_cache_zalloc(fd_table_cache);
 
 
   /* Call the kernel_thread if it scheduled.
@@ -295,8 +457,9 @@ thread_unblock(struct thread* t) {
 
   old_level = intr_disable();
   ASSERT(t->status == THREAD_BLOCKED);
-  // list_push_back(&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem, thread_compare_priority, NULL);
+  if (thread_cfs)
+    cfs_place(t);
+  ready_queue_push(t);
   t->status = THREAD_READY;
 
   intr_set_level(old_level);
@@ -341,10 +504,14 @@ thread_exit(void) {
 #ifdef USERPROG
   process_exit();
 #endif
+  memtrack_thread_exit(thread_current());
 
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable();
+  list_remove(&thread_current()->all_elem);
+  if (thread_current()->mlfqs_dirty)
+    list_remove(&thread_current()->mlfqs_elem);
   do_schedule(THREAD_DYING);
   NOT_REACHED();
 }
@@ -360,16 +527,66 @@ thread_yield(void) {
 
   old_level = intr_disable();
   if (curr != idle_thread)
-    // list_push_back(&ready_list, &curr->elem);
-    list_insert_ordered(&ready_list, &curr->elem, thread_compare_priority, NULL);
+    ready_queue_push(curr);
 
   do_schedule(THREAD_READY);
   intr_set_level(old_level);
 }
 
+/* Unblocks T and, if T should preempt the running thread,
+   switches to it right away.  This is thread_unblock() followed
+   by thread_test_preemption(), except that T does not make a
+   round trip through the run queue: the running thread is queued
+   and the scheduler hands the CPU straight to T.
+
+   The handoff is taken only when T would be chosen next anyway,
+   that is, when its priority is above the running thread's and
+   above every ready thread's.  Otherwise, and under the
+   fair-share scheduler, T just becomes ready. */
+void
+thread_yield_to(struct thread* t) {
+  struct thread* curr = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+  ASSERT(is_thread(t));
+
+  old_level = intr_disable();
+  ASSERT(t->status == THREAD_BLOCKED);
+  if (!thread_cfs && t->priority > curr->priority
+    && t->priority > ready_queue_top_priority(&runqueue)) {
+    if (curr != idle_thread)
+      ready_queue_push(curr);
+    do_schedule_to(THREAD_READY, t);
+  }
+  else {
+    thread_unblock(t);
+    thread_test_preemption();
+  }
+  intr_set_level(old_level);
+}
+
+/* Invokes function 'func' on all threads, passing along 'aux'.
+   This function must be called with interrupts off. */
+void
+thread_foreach(thread_action_func* func, void* aux) {
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
+    struct thread* t = list_entry(e, struct thread, all_elem);
+    func(t, aux);
+  }
+}
+
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority(int new_priority) {
+  /* mlfqs에서는 스케줄러가 우선순위를 직접 계산한다. */
+  if (thread_mlfqs)
+    return;
+
   // 우선순위가 낮아졌다면 우선순위가 높은 쓰레드에게 넘김
   thread_current()->original_priority = new_priority; // donation을 위한 추가
   refresh_priority(); // 변경된 우선순위 반영하여 다시 donation
@@ -382,31 +599,147 @@ thread_get_priority(void) {
   return thread_current()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recalculates
+   its priority, yielding if it no longer has the highest one. */
 void
-thread_set_nice(int nice UNUSED) {
-  /* TODO: Your implementation goes here */
+thread_set_nice(int nice) {
+  struct thread* curr = thread_current();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  /* The fair-share scheduler reads NICE through cfs_weight(). */
+  old_level = intr_disable();
+  curr->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority(curr);
+  intr_set_level(old_level);
+
+  thread_test_preemption();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice(void) {
-  /* TODO: Your implementation goes here */
-  return 0;
+  return thread_current()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg(void) {
-  /* TODO: Your implementation goes here */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load_avg_100 = fp_to_int_round(fp_mul_int(load_avg, 100));
+  intr_set_level(old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu(void) {
-  /* TODO: Your implementation goes here */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent_cpu_100 =
+    fp_to_int_round(fp_mul_int(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+
+  return recent_cpu_100;
+}
+
+/* 4.4BSD scheduler bookkeeping for one timer tick, T being the
+   running thread.  Runs in the timer interrupt.
+
+   recent_cpu of the running thread grows every tick, so it is
+   put on mlfqs_dirty_list.  Once per second load_avg and every
+   thread's recent_cpu change, so all priorities are recomputed;
+   on the other MLFQS_PRIORITY_PERIOD boundaries only the dirty
+   threads are. */
+static void
+mlfqs_tick(struct thread* t) {
+  int64_t now = timer_ticks();
+  struct list_elem* e;
+
+  if (t != idle_thread) {
+    t->recent_cpu = fp_add_int(t->recent_cpu, 1);
+    if (!t->mlfqs_dirty) {
+      t->mlfqs_dirty = true;
+      list_push_back(&mlfqs_dirty_list, &t->mlfqs_elem);
+    }
+  }
+
+  if (now % TIMER_FREQ == 0) {
+    mlfqs_update_load_avg();
+    for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
+      struct thread* th = list_entry(e, struct thread, all_elem);
+      mlfqs_update_recent_cpu(th);
+      mlfqs_update_priority(th);
+    }
+  }
+  else if (now % MLFQS_PRIORITY_PERIOD != 0)
+    return;
+
+  while (!list_empty(&mlfqs_dirty_list)) {
+    struct thread* th =
+      list_entry(list_pop_front(&mlfqs_dirty_list), struct thread, mlfqs_elem);
+    th->mlfqs_dirty = false;
+    mlfqs_update_priority(th);
+  }
+
+  if (t != idle_thread && t->priority < ready_queue_top_priority(&runqueue))
+    intr_yield_on_return();
+}
+
+/* Recomputes T's priority as
+   PRI_MAX - (recent_cpu / 4) - (nice * 2), clamped to
+   PRI_MIN..PRI_MAX. */
+static void
+mlfqs_update_priority(struct thread* t) {
+  int priority;
+
+  if (t == idle_thread)
+    return;
+
+  priority = PRI_MAX - fp_to_int(fp_div_int(t->recent_cpu, 4)) - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  /* 세마포어에서 대기 중이면 waiters 안의 위치도 갱신해야 한다. */
+  enum intr_level old_level = intr_disable();
+  priority_update(t, priority);
+  intr_set_level(old_level);
+}
+
+/* Decays T's recent_cpu as
+   (2 * load_avg) / (2 * load_avg + 1) * recent_cpu + nice. */
+static void
+mlfqs_update_recent_cpu(struct thread* t) {
+  fixed_t twice_load;
+
+  if (t == idle_thread)
+    return;
+
+  twice_load = fp_mul_int(load_avg, 2);
+  t->recent_cpu = fp_add_int(
+    fp_mul(fp_div(twice_load, fp_add_int(twice_load, 1)), t->recent_cpu),
+    t->nice);
+}
+
+/* Updates load_avg as
+   (59/60) * load_avg + (1/60) * ready_threads, where ready_threads
+   counts the ready threads plus the running one, if not idle. */
+static void
+mlfqs_update_load_avg(void) {
+  int ready_threads = runqueue.cnt;
+
+  if (thread_current() != idle_thread)
+    ready_threads++;
+
+  load_avg = fp_add(fp_mul(fp_div_int(int_to_fp(59), 60), load_avg),
+    fp_mul_int(fp_div_int(int_to_fp(1), 60), ready_threads));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -428,8 +761,23 @@ idle(void* idle_started_ UNUSED) {
   for (;;) {
     /* Let someone else run. */
     intr_disable();
+    timer_idle_exit();
     thread_block();
 
+    /* Nothing to run: zero free pages for PAL_ZERO meanwhile, a
+       page at a time, and go back to the scheduler as soon as a
+       real thread is ready. */
+    intr_enable();
+    while (runqueue.cnt == 0 && palloc_zero_idle())
+      continue;
+    intr_disable();
+    if (runqueue.cnt > 0)
+      continue;
+
+    /* Still nothing to run: in tickless mode, ask for the next timer
+       interrupt only when the next timer deadline is due. */
+    timer_idle_enter();
+
     /* Re-enable interrupts and wait for the next one.
 
        The `sti' instruction disables interrupts until the
@@ -471,9 +819,15 @@ init_thread(struct thread* t, const char* name, int priority) {
   t->priority = priority;
   t->original_priority = priority;
   t->wait_on_lock = NULL;
-  list_init(&t->donations);
+  heap_init(&t->held_locks, lock_compare_donation, NULL);
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
   t->magic = THREAD_MAGIC;
 
+  enum intr_level old_level = intr_disable();
+  list_push_back(&all_list, &t->all_elem);
+  intr_set_level(old_level);
+
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -483,10 +837,188 @@ init_thread(struct thread* t, const char* name, int priority) {
    idle_thread. */
 static struct thread*
 next_thread_to_run(void) {
-  if (list_empty(&ready_list))
-    return idle_thread;
+  struct runqueue* rq = &runqueue;
+  struct thread* next = idle_thread;
+
+  if (rq->cnt != 0) {
+    next = ready_queue_pop(rq);
+
+    /* NEXT had the least vruntime of all, so it is the new floor. */
+    if (thread_cfs && next->vruntime > rq->min_vruntime)
+      rq->min_vruntime = next->vruntime;
+  }
+  return next;
+}
+
+/* Appends T to the ready queue of its priority in the run queue.
+   Threads of equal priority therefore run in FIFO order. */
+static void
+ready_queue_push(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  runqueue_add(&runqueue, t);
+}
+
+/* Removes and returns the next thread to run from RQ: the first
+   thread of the highest-priority
+   nonempty ready queue, or under the fair-share scheduler the
+   thread with the least vruntime.  RQ must not be empty. */
+static struct thread*
+ready_queue_pop(struct runqueue* rq) {
+  struct thread* t;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(rq->cnt > 0);
+
+  if (thread_cfs)
+    t = rb_entry(rb_first(&rq->cfs_tree), struct thread, cfs_node);
   else
-    return list_entry(list_pop_front(&ready_list), struct thread, elem);
+    t = list_entry(list_front(&rq->queues[ready_queue_top_priority(rq)]),
+      struct thread, elem);
+  runqueue_del(rq, t);
+  return t;
+}
+
+/* Removes T from the ready queue of its current priority. */
+static void
+ready_queue_remove(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  runqueue_del(&runqueue, t);
+}
+
+/* Adds T to RQ.  Interrupts must be off. */
+static void
+runqueue_add(struct runqueue* rq, struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (thread_cfs) {
+    t->cfs_weight = cfs_weight(t);
+    rb_insert(&rq->cfs_tree, &t->cfs_node);
+    rq->cfs_load += t->cfs_weight;
+  }
+  else {
+    list_push_back(&rq->queues[t->priority], &t->elem);
+    rq->bitmap |= 1ULL << t->priority;
+  }
+  rq->cnt++;
+}
+
+/* Removes T from RQ.  Interrupts must be off. */
+static void
+runqueue_del(struct runqueue* rq, struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (thread_cfs) {
+    rb_remove(&rq->cfs_tree, &t->cfs_node);
+    rq->cfs_load -= t->cfs_weight;
+  }
+  else {
+    list_remove(&t->elem);
+    if (list_empty(&rq->queues[t->priority]))
+      rq->bitmap &= ~(1ULL << t->priority);
+  }
+  rq->cnt--;
+}
+
+/* Returns the highest priority with a ready thread in RQ, or -1
+   if no thread is ready.  A single bsr finds the most
+   significant set bit of the bitmap. */
+static int
+ready_queue_top_priority(const struct runqueue* rq) {
+  uint64_t bitmap = rq->bitmap;
+
+  if (bitmap == 0)
+    return -1;
+  return 63 - __builtin_clzll(bitmap);
+}
+
+/* Orders threads in a fair-share run queue by vruntime. */
+static bool
+cfs_less(const struct rb_node* a, const struct rb_node* b, void* aux UNUSED) {
+  return rb_entry(a, struct thread, cfs_node)->vruntime
+    < rb_entry(b, struct thread, cfs_node)->vruntime;
+}
+
+/* Returns T's fair-share weight.  Priority is read as a nice
+   offset, two priority levels per nice level around PRI_DEFAULT,
+   so that thread_set_priority() and donation still matter; the
+   thread's own nice is added on top. */
+static unsigned
+cfs_weight(const struct thread* t) {
+  int nice = t->nice - (t->priority - PRI_DEFAULT) / 2;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  if (nice > NICE_MAX)
+    nice = NICE_MAX;
+  return cfs_nice_weight[nice - NICE_MIN];
+}
+
+/* Charges the running thread T for one tick and advances the
+   vruntime floor.  Runs in the timer interrupt. */
+static void
+cfs_tick(struct thread* t) {
+  struct runqueue* rq = &runqueue;
+  struct rb_node* first;
+  uint64_t floor;
+
+  t->vruntime += CFS_TICK_NSEC * NICE_0_WEIGHT / cfs_weight(t);
+
+  floor = t->vruntime;
+  first = rb_first(&rq->cfs_tree);
+  if (first != NULL && rb_entry(first, struct thread, cfs_node)->vruntime < floor)
+    floor = rb_entry(first, struct thread, cfs_node)->vruntime;
+  if (floor > rq->min_vruntime)
+    rq->min_vruntime = floor;
+}
+
+/* Places T, which is waking up, in virtual time.  A thread that
+   slept for long would otherwise have a vruntime far behind and
+   monopolize the CPU; it is pulled up to the floor of its run
+   queue, less a small credit so that it still runs soon. */
+static void
+cfs_place(struct thread* t) {
+  uint64_t min_vruntime = runqueue.min_vruntime;
+  uint64_t floor = min_vruntime > CFS_SLEEPER_CREDIT
+    ? min_vruntime - CFS_SLEEPER_CREDIT : 0;
+
+  if (t->vruntime < floor)
+    t->vruntime = floor;
+}
+
+/* Returns true if the thread with the least vruntime in RQ is
+   far enough behind CURR that it should run now. */
+static bool
+cfs_preempts(struct runqueue* rq, struct thread* curr) {
+  enum intr_level old_level = intr_disable();
+  struct rb_node* first;
+  bool preempt = false;
+
+  first = rb_first(&rq->cfs_tree);
+  if (first != NULL)
+    preempt = curr == idle_thread
+      || rb_entry(first, struct thread, cfs_node)->vruntime + CFS_WAKEUP_GRAN
+         < curr->vruntime;
+  intr_set_level(old_level);
+
+  return preempt;
+}
+
+/* Returns the number of ticks T may run before it is preempted:
+   its share, by weight, of a period in which every thread in RQ
+   runs once.  The period is CFS_LATENCY, stretched so that no
+   slice falls below CFS_MIN_GRANULARITY. */
+static unsigned
+cfs_slice(struct runqueue* rq, struct thread* t) {
+  unsigned weight = cfs_weight(t);
+  uint64_t period = CFS_LATENCY;
+  uint64_t slice;
+
+  if ((rq->cnt + 1) * CFS_MIN_GRANULARITY > period)
+    period = (rq->cnt + 1) * CFS_MIN_GRANULARITY;
+  slice = period * weight / (rq->cfs_load + weight);
+  return slice < CFS_MIN_GRANULARITY ? CFS_MIN_GRANULARITY : slice;
 }
 
 /* Use iretq to launch the thread */
@@ -593,24 +1125,40 @@ thread_launch(struct thread* th) {
  * It's not safe to call printf() in the schedule(). */
 static void
 do_schedule(int status) {
+  do_schedule_to(status, NULL);
+}
+
+/* Same as do_schedule(), but switches to NEXT, a thread that is
+   in no run queue, instead of the scheduler's choice, unless NEXT
+   is a null pointer. */
+static void
+do_schedule_to(int status, struct thread* next) {
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(thread_current()->status == THREAD_RUNNING);
   while (!list_empty(&destruction_req)) {
     struct thread* victim =
       list_entry(list_pop_front(&destruction_req), struct thread, elem);
-    palloc_free_page(victim);
+    thread_page_free(victim);
   }
   thread_current()->status = status;
-  schedule();
+  schedule_to(next);
 }
 
 static void
 schedule(void) {
+  schedule_to(NULL);
+}
+
+/* Switches to NEXT, or to next_thread_to_run() if NEXT is a null
+   pointer. */
+static void
+schedule_to(struct thread* next) {
 
   enum intr_level old_level;
   old_level = intr_disable();
   struct thread* curr = running_thread();
-  struct thread* next = next_thread_to_run();
+  if (next == NULL)
+    next = next_thread_to_run();
 
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(curr->status != THREAD_RUNNING);
@@ -620,6 +1168,7 @@ schedule(void) {
 
   /* Start new time slice. */
   thread_ticks = 0;
+  time_slice = thread_cfs ? cfs_slice(&runqueue, next) : TIME_SLICE;
 
   intr_set_level(old_level);
 #ifdef USERPROG
@@ -646,6 +1195,43 @@ schedule(void) {
   }
 }
 
+/* Returns a page for a new thread, from thread_cache if it has
+   one, or a null pointer if memory is exhausted. */
+static struct thread*
+thread_page_alloc(void) {
+  struct thread* t = NULL;
+  enum intr_level old_level = intr_disable();
+
+  if (!list_empty(&thread_cache)) {
+    t = list_entry(list_pop_front(&thread_cache), struct thread, elem);
+    thread_cache_cnt--;
+    thread_cache_hits++;
+  }
+  else
+    thread_cache_misses++;
+  intr_set_level(old_level);
+
+  if (t == NULL)
+    t = palloc_get_page(PAL_ZERO);
+  return t;
+}
+
+/* Frees the page of dead thread T, keeping it in thread_cache if
+   there is room.  Called with interrupts off. */
+static void
+thread_page_free(struct thread* t) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  /* 캐시에 있는 페이지가 스레드로 오인되지 않도록 magic을 지운다. */
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_MAX) {
+    list_push_front(&thread_cache, &t->elem);
+    thread_cache_cnt++;
+  }
+  else
+    palloc_free_page(t);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid(void) {
@@ -658,11 +1244,3 @@ allocate_tid(void) {
 
   return tid;
 }
-
-bool earlier_wake_up(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED)
-{
-  struct thread* thread_a = list_entry(a, struct thread, elem);
-  struct thread* thread_b = list_entry(b, struct thread, elem);
-
-  return thread_a->wakeup_tick < thread_b->wakeup_tick;
-}
\ No newline at end of file
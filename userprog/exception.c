@@ -132,9 +132,10 @@ page_fault (struct intr_frame *f) {
 	fault_addr = (void *) rcr2();
 
 	/* bad behavior  */
-
+#ifndef VM
 	if(!is_user_vaddr(fault_addr) || pml4_get_page(thread_current()->pml4, fault_addr) == NULL || fault_addr == NULL)
 		exit(-1);
+#endif
 	
 
 	/* Turn interrupts back on (they were only off so that we could
@@ -151,6 +152,10 @@ page_fault (struct intr_frame *f) {
 	/* For project 3 and later. */
 	if (vm_try_handle_fault (f, fault_addr, user, write, not_present))
 		return;
+	/* A fault on a user address that the VM can't resolve is the
+	   process's fault, even when the kernel took it in a syscall. */
+	if (user || is_user_vaddr (fault_addr))
+		exit (-1);
 #endif
 
 	/* Count page faults. */
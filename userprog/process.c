@@ -15,6 +15,7 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
@@ -107,6 +108,18 @@ struct fork_args {
     struct intr_frame parent_if;      // 부모의 intr_frame '복사본'
 };
 
+/* fork마다 하나씩 쓰이는 struct fork_args용 캐시. */
+static struct kmem_cache *fork_args_cache;
+
+/* Creates the object caches used by process_fork(). */
+void
+process_cache_init (void) {
+	fork_args_cache = kmem_cache_create ("fork_args",
+			sizeof (struct fork_args), NULL);
+	if (fork_args_cache == NULL)
+		PANIC ("process_cache_init: out of memory");
+}
+
 tid_t
 process_fork (const char *name, struct intr_frame *if_) {
 	/* Clone current thread to new thread.*/
@@ -114,7 +127,7 @@ process_fork (const char *name, struct intr_frame *if_) {
 	//printf("process_fork: %s\n", name);
 	old_level = intr_disable();
 	
-	struct fork_args *fargs = calloc(1, sizeof(struct fork_args));
+	struct fork_args *fargs = kmem_cache_zalloc(fork_args_cache);
     if (fargs == NULL) {
         return TID_ERROR; // 메모리 할당 실패
     }
@@ -128,16 +141,16 @@ process_fork (const char *name, struct intr_frame *if_) {
 	//printf("forking tid: %d\n",tid);
 	if(tid < 0) {
 		//printf("tid < 0\n");
-		free(fargs);
+		kmem_cache_free(fork_args_cache, fargs);
 		return TID_ERROR;
 	}
 	//printf("ch_st: %p\n", ch_st);
 	//lock_acquire(&thread_current()->childlist_lock);
 	//lock_release(&thread_current()->childlist_lock);
 	
-	struct child_status *ch_st = calloc(1, sizeof(struct child_status));
+	struct child_status *ch_st = kmem_cache_zalloc(child_status_cache);
 	if(ch_st == NULL){
-		free(fargs);
+		kmem_cache_free(fork_args_cache, fargs);
 		//printf("ch_st failed\n");
 		return TID_ERROR;
 	}
@@ -161,7 +174,7 @@ process_fork (const char *name, struct intr_frame *if_) {
 	// 자식의 tid를 반환하게 된다.
 	if(!ch_st->fork_success) {
 		list_remove(&ch_st->elem);
-		free(ch_st);
+		kmem_cache_free(child_status_cache, ch_st);
 		return TID_ERROR;
 	}
 
@@ -169,46 +182,84 @@ process_fork (const char *name, struct intr_frame *if_) {
 }
 
 #ifndef VM
+/* Pages copied by duplicate_pte() but not yet mapped in the child.
+ * Consecutive pages with the same permission are mapped together
+ * with one pml4_map_range(). */
+#define FORK_BATCH 32
+struct fork_copy {
+	uint8_t *start;                 /* User address of KPAGES[0]. */
+	bool writable;
+	size_t cnt;                     /* # of pages in KPAGES. */
+	void *kpages[FORK_BATCH];       /* Child's copies. */
+};
+
+/* Maps the pending pages of FC into the current process.  Frees
+ * them on failure. */
+static bool
+fork_copy_flush (struct fork_copy *fc) {
+	bool success = fc->cnt == 0
+		|| pml4_map_range (thread_current ()->pml4, fc->start, fc->kpages,
+				fc->cnt, fc->writable);
+	if (!success)
+		for (size_t i = 0; i < fc->cnt; i++)
+			palloc_free_page (fc->kpages[i]);
+	fc->cnt = 0;
+	return success;
+}
+
 /* Duplicate the parent's address space by passing this function to the
  * pml4_for_each. This is only for the project 2. */
 // 부모 프로세스의 페이지 테이블을 자식에게 복사하는 함수
+// 복사한 페이지는 AUX(struct fork_copy)에 모았다가 한 번에 매핑한다.
 static bool
 duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	// 부모 쓰레드의 페이지 테이블을 순회함
-	struct thread *current = thread_current ();
-	struct thread *parent = (struct thread *) aux;
+	struct fork_copy *fc = aux;
 	void *parent_page;
 	void *newpage;
 	bool writable;
+	enum intr_level old_level;
 	//printf("duplicate_pte\n");
 	/* 1. TODO: If the parent_page is kernel page, then return immediately. */
 	if (is_kernel_vaddr(va)) return true;
 	/* 2. Resolve VA from the parent's page map level 4. */
-	// 해당 가상 주소와 연결된 물리주소의 커널 가상주소
-	parent_page = pml4_get_page (parent->pml4, va);
-	if(parent_page == NULL) return false;
-	//if(parent_page == NULL || is_kernel_vaddr(parent_page)) return true;
-
 	/* 3. TODO: Allocate new PAL_USER page for the child and set result to
 	 *    TODO: NEWPAGE. */
 
 	// 유저풀에서 한페이지만큼 할당, 커널 가상 주소
 	newpage = palloc_get_page(PAL_USER);
-	if (newpage == NULL)
+	if (newpage == NULL) {
+		fork_copy_flush (fc);
 		return false;
+	}
 	/* 4. TODO: Duplicate parent's page to the new page and
 	 *    TODO: check whether parent's page is writable or not (set WRITABLE
 	 *    TODO: according to the result). */
+	// 해당 가상 주소와 연결된 물리주소의 커널 가상주소
+	// pml4_for_each가 넘겨준 PTE에서 바로 구한다.
+	// 복사 중에 compaction이 부모 페이지를 옮기지 못하도록 인터럽트를 끈다.
+	old_level = intr_disable ();
+	parent_page = ptov (PTE_ADDR (*pte));
 	memcpy(newpage, parent_page, PGSIZE);
+	intr_set_level (old_level);
 	writable = is_writable(pte) != 0;
 
 	/* 5. Add new page to child's page table at address VA with WRITABLE
 	 *    permission. */
-	if (!pml4_set_page (current->pml4, va, newpage, writable)) {
-		/* 6. TODO: if fail to insert page, do error handling. */
-		palloc_free_page(newpage);
-		return false;
+	// 앞 페이지들과 이어지지 않으면 모아둔 것부터 매핑
+	if (fc->cnt > 0 && ((uint8_t *) va != fc->start + PGSIZE * fc->cnt
+				|| writable != fc->writable || fc->cnt == FORK_BATCH)) {
+		if (!fork_copy_flush (fc)) {
+			/* 6. TODO: if fail to insert page, do error handling. */
+			palloc_free_page(newpage);
+			return false;
+		}
+	}
+	if (fc->cnt == 0) {
+		fc->start = va;
+		fc->writable = writable;
 	}
+	fc->kpages[fc->cnt++] = newpage;
 	return true;
 }
 #endif
@@ -233,7 +284,7 @@ __do_fork (void *aux) {
 	struct intr_frame if_;
 	memcpy(&if_, &fargs->parent_if, sizeof(struct intr_frame));
 	
-	free(fargs);
+	kmem_cache_free(fork_args_cache, fargs);
 	
 	if_.R.rax = 0;
 
@@ -290,7 +341,9 @@ __do_fork (void *aux) {
 		goto error;
 #else
 	
-	if (!pml4_for_each (parent->pml4, duplicate_pte, parent)){
+	struct fork_copy fc = { .cnt = 0 };
+	if (!pml4_for_each (parent->pml4, duplicate_pte, &fc)
+			|| !fork_copy_flush (&fc)){
 
 
 		goto error;
@@ -345,7 +398,7 @@ error:
 		if(fd_entries[i] == NULL) continue;
 		file_close(fd_entries[i]);
 	}
-	free(current->fd_table);
+	kmem_cache_free(fd_table_cache, current->fd_table);
 	if(current->user_prog != NULL) {
 		file_close(current->user_prog);
 	}
@@ -474,7 +527,7 @@ process_wait (tid_t child_tid UNUSED) {
 
 	if(!ch_st->has_exited){
 		list_remove(&ch_st->elem);
-		free(ch_st);
+		kmem_cache_free(child_status_cache, ch_st);
 		return TID_ERROR;
 	}
 
@@ -482,7 +535,7 @@ process_wait (tid_t child_tid UNUSED) {
 	int exit_status = ch_st->exit_status;
 	// 반환
 	list_remove(&ch_st->elem);
-	free(ch_st);
+	kmem_cache_free(child_status_cache, ch_st);
 	//lock_release(&thread_current()->childlist_lock);
 	return exit_status;
 
@@ -859,6 +912,9 @@ validate_segment (const struct Phdr *phdr, struct file *file) {
 /* load() helpers. */
 static bool install_page (void *upage, void *kpage, bool writable);
 
+/* Most pages load_segment() maps at once. */
+#define LOAD_BATCH 32
+
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -882,35 +938,52 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 
 	file_seek (file, ofs);
 	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* Get a page of memory. */
-		uint8_t *kpage = palloc_get_page (PAL_USER);
-		if (kpage == NULL)
-			return false;
+		/* Load up to LOAD_BATCH pages, then map them all with one
+		 * page table walk. */
+		void *kpages[LOAD_BATCH];
+		uint8_t *batch_upage = upage;
+		size_t cnt = 0;
+		bool success = true;
+
+		while (cnt < LOAD_BATCH && (read_bytes > 0 || zero_bytes > 0)) {
+			/* Do calculate how to fill this page.
+			 * We will read PAGE_READ_BYTES bytes from FILE
+			 * and zero the final PAGE_ZERO_BYTES bytes. */
+			size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+			size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+			/* Get a page of memory. */
+			uint8_t *kpage = palloc_get_page (PAL_USER);
+			if (kpage == NULL) {
+				success = false;
+				break;
+			}
+			kpages[cnt++] = kpage;
 
-		/* Load this page. */
-		if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes) {
-			palloc_free_page (kpage);
-			return false;
+			/* Load this page. */
+			if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes) {
+				success = false;
+				break;
+			}
+			memset (kpage + page_read_bytes, 0, page_zero_bytes);
+
+			/* Advance. */
+			read_bytes -= page_read_bytes;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
 		}
-		memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-		/* Add the page to the process's address space. */
-		if (!install_page (upage, kpage, writable)) {
+		/* Add the pages to the process's address space. */
+		if (success && !pml4_map_range (thread_current ()->pml4, batch_upage,
+					kpages, cnt, writable)) {
 			printf("fail\n");
-			palloc_free_page (kpage);
+			success = false;
+		}
+		if (!success) {
+			for (size_t i = 0; i < cnt; i++)
+				palloc_free_page (kpages[i]);
 			return false;
 		}
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
 	}
 	return true;
 }
@@ -951,23 +1024,15 @@ static bool
 install_page (void *upage, void *kpage, bool writable) {
 	struct thread *t = thread_current ();
 
-	/* Verify that there's not already a page at that virtual
-	 * address, then map our page there. */
-	return (pml4_get_page (t->pml4, upage) == NULL
-			&& pml4_set_page (t->pml4, upage, kpage, writable));
+	/* pml4_map_range() fails, without mapping it, if there's
+	 * already a page at that virtual address. */
+	return pml4_map_range (t->pml4, upage, &kpage, 1, writable);
 }
 #else
 /* From here, codes will be used after project 3.
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -989,25 +1054,10 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-	}
-	return true;
+	/* The whole segment is one area; its pages are read in from
+	 * FILE as they are first touched. */
+	return vm_alloc_area (VM_ANON, upage, (read_bytes + zero_bytes) / PGSIZE,
+			writable, read_bytes > 0 ? file : NULL, ofs, read_bytes);
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -1016,11 +1066,14 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	/* The stack area starts out one page long, claimed now, and
+	 * grows down as faults below it ask for more. */
+	if (vm_alloc_area (VM_ANON | VM_STACK, stack_bottom, 1, true,
+				NULL, 0, 0)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
@@ -14,6 +14,12 @@
 #include "include/lib/string.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/slab.h"
+#include "threads/memtrack.h"
+#include "threads/mmu.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 // #include "filesys/inode.h"
 // #include "threads/malloc.h"
 // /* An open file. */
@@ -41,6 +47,7 @@ unsigned tell(int fd);
 void close (int fd);
 bool isValidAddress(const void *ptr);
 bool isValidString(const char *str);
+void check_valid_buffer(const void *buffer, unsigned size, bool write);
 
 struct lock filesys_lock;
 
@@ -70,6 +77,7 @@ syscall_init (void) {
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
 
 	lock_init(&filesys_lock);
+	lock_set_name(&filesys_lock, "filesys_lock");
 }
 
 /* The main system call interface */
@@ -79,6 +87,11 @@ syscall_handler (struct intr_frame *f UNUSED) {
 
 	// 시스템 콜 번호
 	uint64_t syscall_num = f->R.rax;
+#ifdef VM
+	/* A fault the kernel takes on a user buffer needs the user
+	 * rsp to tell whether the stack should grow. */
+	thread_current()->user_rsp = f->rsp;
+#endif
 
 	switch(syscall_num){
 		case SYS_HALT:
@@ -124,6 +137,21 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		case SYS_CLOSE:
 			close((int)f->R.rdi);
 			break;
+		case SYS_LOCKSTAT:
+			lock_print_stats();
+			break;
+		case SYS_MEMSTAT:
+			memtrack_print_stats();
+			break;
+#ifdef VM
+		case SYS_MMAP:
+			f->R.rax = (uint64_t)mmap((void *)f->R.rdi, (size_t)f->R.rsi,
+					(int)f->R.rdx, (int)f->R.r10, (off_t)f->R.r8);
+			break;
+		case SYS_MUNMAP:
+			munmap((void *)f->R.rdi);
+			break;
+#endif
 		default:
 			thread_exit();
 	}
@@ -148,13 +176,13 @@ void exit(int status){
 		if(fd_entries[i] == NULL) continue;
 		file_close(fd_entries[i]);
 	}
-	free(curr->fd_table);
+	kmem_cache_free(fd_table_cache, curr->fd_table);
 
 	struct list *child_list = &curr->child_list;
 	while (!list_empty(child_list)) {
 		struct list_elem *e = list_pop_front(child_list);
 		struct child_status *ch = list_entry(e, struct child_status, elem);
-		free(ch); // 부모가 종료되므로, 자식 상태 정보 해제
+		kmem_cache_free(child_status_cache, ch); // 부모가 종료되므로, 자식 상태 정보 해제
 	}
 
 	struct child_status *ch_st = curr->child_status;
@@ -166,10 +194,10 @@ void exit(int status){
 		printf("%s: exit(%d)\n", curr->name, status);
 		sema_up(&ch_st->sema_wait);
 
-		if(!list_empty(&ch_st->sema_fork.waiters)){
+		if(!heap_empty(&ch_st->sema_fork.waiters)){
 			sema_up(&ch_st->sema_fork);
 		}
-		if(!list_empty(&ch_st->sema_wait.waiters)){
+		if(!heap_empty(&ch_st->sema_wait.waiters)){
 			sema_up(&ch_st->sema_wait);
 		}
 	}
@@ -262,7 +290,9 @@ int read(int fd, void *buffer, unsigned size){
 	if(fd < 0) exit(-1);
 	if(fd == 1) exit(-1);
 	if(fd >= FD_MAX) exit(-1);
-	check_valid_buffer(buffer, size);
+	// 커널이 버퍼에 쓰므로 쓰기 가능한지도 확인한다.
+	// 락을 잡은 뒤 쓰기 폴트로 exit하면 락이 풀리지 않는다.
+	check_valid_buffer(buffer, size, true);
 	if(fd == 0){
 		char c;
 		int i=0;
@@ -295,7 +325,7 @@ int write(int fd, const void *buffer, unsigned size){
 	if(fd >= FD_MAX) exit(-1);
 	
 	// 표준 출력
-	check_valid_buffer(buffer, size);
+	check_valid_buffer(buffer, size, false);
 	if(fd == 1 || fd == 2){
 		putbuf(buffer, (size_t)size);
 		return (int)size;
@@ -330,7 +360,26 @@ void close(int fd){
 	file_close(file);
 }
 
+#ifdef VM
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset){
+	if(addr == NULL || pg_ofs(addr) != 0 || pg_ofs(offset) != 0) return NULL;
+	if(length == 0 || !is_user_vaddr((uint8_t *)addr + length - 1)) return NULL;
+	if(fd < 3 || fd >= FD_MAX) return NULL;
+	struct file *file = thread_current()->fd_table->fd_entries[fd];
+	if(file == NULL) return NULL;
+	return do_mmap(addr, length, writable, file, offset);
+}
+
+void munmap(void *addr){
+	do_munmap(addr);
+}
+#endif
+
 bool isValidAddress(const void *ptr){
+#ifdef VM
+	// 아직 올라오지 않은 페이지도 영역 안이면 유효하다
+	return vm_addr_is_valid(ptr);
+#endif
 	if(is_user_vaddr(ptr)){
 		if(pml4_get_page(thread_current()->pml4, ptr) != NULL)
 			return true;
@@ -346,17 +395,28 @@ bool isValidString(const char *str){
 	return false;
 }
 
-void check_valid_buffer(const void *buffer, unsigned size) {
+void check_valid_buffer(const void *buffer, unsigned size, bool write) {
     uint8_t *ptr = (uint8_t *)buffer;
-    struct thread *curr = thread_current();
+    uint8_t *end = ptr + size;
 
-    for (unsigned i = 0; i < size; i++) {
+    // 페이지마다 한 번씩만 확인한다. 첫 페이지는 버퍼 시작 주소로,
+    // 나머지는 페이지 시작 주소로 확인한다.
+    for (uint8_t *p = ptr; p < end; p = (uint8_t *)pg_round_down(p) + PGSIZE) {
         // 유저 주소 범위 체크
-        if (!is_user_vaddr(ptr + i))
+        if (!is_user_vaddr(p))
             exit(-1);
 
-        // 페이지 매핑 존재 여부 체크
-        if (pml4_get_page(curr->pml4, ptr + i) == NULL)
+        // 페이지 매핑 존재 여부 체크 (write면 쓰기 가능 여부까지)
+#ifdef VM
+        if (write ? !vm_addr_is_writable(p) : !vm_addr_is_valid(p))
+            exit(-1);
+#else
+        struct thread *curr = thread_current();
+        uint64_t *pte = pml4e_walk(curr->pml4, (uint64_t)p, 0);
+        if (pte == NULL || (*pte & PTE_P) == 0)
+            exit(-1);
+        if (write && !is_writable(pte))
             exit(-1);
+#endif
     }
 }
@@ -1,7 +1,32 @@
-/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
+/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page).
+ *
+ * Swap.
+ * The swap disk is cut into slots of SLOT_SECTORS sectors, one
+ * page each.  A page keeps its slot while it lives, even after it
+ * has been read back in, so that a page which has not been written
+ * to since can be evicted again without any I/O: its dirty bit
+ * says whether it still matches its slot, or its area if it has
+ * no slot.  Slots are handed out in runs, so that pages cleaned
+ * together sit together on disk and a fault on one of them can
+ * read its neighbors in too.
+ *
+ * With the compressed cache on (see zswap.c), a dirty page being
+ * evicted is compressed into memory instead, and reaches its slot
+ * only if it does not compress or the cache writes it back. */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <debug.h>
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vma.h"
+#include "vm/zswap.h"
+
+/* Sectors per swap slot. */
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +42,264 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Who holds a swap slot. */
+struct slot_owner {
+	struct page *page;
+	struct thread *thread;
+};
+
+/* Slot allocator.  SWAP_SLOTS marks the slots in use and
+ * SLOT_OWNERS maps each one back to its page, for read-ahead.
+ * SWAP_LOCK guards both. */
+static struct bitmap *swap_slots;
+static struct slot_owner *slot_owners;
+static struct lock swap_lock;
+
+static size_t slot_alloc (size_t cnt);
+static void slot_set_owner (size_t slot, struct page *page,
+		struct thread *owner);
+static void slot_free (size_t slot);
+static void slot_write (size_t slot, const void *kva);
+static void slot_read (size_t slot, void *kva);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SLOT_SECTORS : 0;
+
+	lock_init (&swap_lock);
+	swap_slots = bitmap_create (slot_cnt);
+	slot_owners = calloc (slot_cnt, sizeof *slot_owners);
+	if (swap_slots == NULL || (slot_cnt > 0 && slot_owners == NULL))
+		PANIC ("vm_anon_init: out of memory");
+
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SLOT_NONE;
+	anon_page->zentry = NULL;
+	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the swap disk.
+ * A page that never went to swap was let go only while it still
+ * matched its area, so its area supplies it again.  A page from
+ * the compressed cache matches neither, so it comes back dirty. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (zswap_load (page, kva)) {
+		pml4_set_dirty (page->frame->owner->pml4, page->va, true);
+		return true;
+	}
+	if (anon_page->slot == SLOT_NONE)
+		return vma_load_page (page->vma, page->va, kva);
+	slot_read (anon_page->slot, kva);
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * Only a dirty page is written, to the compressed cache if it
+ * will take it; a clean one is simply dropped.  Returns false if
+ * the swap disk is full. */
 static bool
 anon_swap_out (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (!pml4_is_dirty (frame->owner->pml4, page->va))
+		return true;
+	if (zswap_store (page, frame->owner, frame->kva))
+		return true;
+	return anon_write_slot (page, frame->owner, frame->kva);
+}
+
+/* Writes the page at KVA to PAGE's swap slot, taking one if it
+ * has none yet.  OWNER is the thread that maps PAGE.  Returns
+ * false if the swap disk is full. */
+bool
+anon_write_slot (struct page *page, struct thread *owner, const void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot == SLOT_NONE) {
+		anon_page->slot = slot_alloc (1);
+		if (anon_page->slot == SLOT_NONE)
+			return false;
+		slot_set_owner (anon_page->slot, page, owner);
+	}
+	slot_write (anon_page->slot, kva);
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* Once out of the cache, no write-back can give PAGE a slot. */
+	zswap_invalidate (page);
+	if (anon_page->slot != SLOT_NONE)
+		slot_free (anon_page->slot);
+	vm_release_frame (page);
+}
+
+/* Writes the CNT dirty pages in PAGES, which must be in memory
+ * with their frames pinned, to swap, and leaves them in memory,
+ * clean.  Pages that have no slot yet get a single run of slots,
+ * in order, so that the writes go to consecutive sectors.  A page
+ * is left dirty if the swap disk is full. */
+void
+anon_clean (struct page *pages[], size_t cnt) {
+	size_t fresh_cnt = 0, run;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		if (pages[i]->anon.slot == SLOT_NONE)
+			fresh_cnt++;
+	run = fresh_cnt > 0 ? slot_alloc (fresh_cnt) : SLOT_NONE;
+
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		struct anon_page *anon_page = &page->anon;
+		uint64_t *pml4 = page->frame->owner->pml4;
+
+		ASSERT (VM_TYPE (page->operations->type) == VM_ANON);
+
+		if (anon_page->slot == SLOT_NONE) {
+			if (run != SLOT_NONE)
+				anon_page->slot = run++;
+			else
+				anon_page->slot = slot_alloc (1);
+			if (anon_page->slot == SLOT_NONE)
+				continue;
+			slot_set_owner (anon_page->slot, page, page->frame->owner);
+		}
+
+		/* Clear the dirty bit before the write, so that a store
+		 * racing with it leaves the page dirty again. */
+		pml4_set_dirty (pml4, page->va, false);
+		slot_write (anon_page->slot, page->frame->kva);
+	}
+}
+
+/* Reads in the pages of the current thread that sit in the same
+ * run of SWAP_CLUSTER slots as PAGE, which was just read from
+ * swap, as long as there are free frames for them. */
+void
+anon_readahead (struct page *page) {
+	size_t slot, first, s;
+
+	if (!anon_in_swap (page) || page->anon.slot == SLOT_NONE)
+		return;
+
+	slot = page->anon.slot;
+	first = slot - slot % SWAP_CLUSTER;
+	for (s = first; s < first + SWAP_CLUSTER
+			&& s < bitmap_size (swap_slots); s++) {
+		struct page *next = NULL;
+
+		/* Only the owner frees its pages, so a page of ours found
+		 * here stays valid after the lock is dropped. */
+		lock_acquire (&swap_lock);
+		if (s != slot && bitmap_test (swap_slots, s)
+				&& slot_owners[s].thread == thread_current ())
+			next = slot_owners[s].page;
+		lock_release (&swap_lock);
+
+		if (next != NULL && next->frame == NULL
+				&& !vm_prefetch_page (next))
+			break;
+	}
+}
+
+/* Returns true if PAGE is an anonymous page with a copy in swap
+ * or in the compressed cache. */
+bool
+anon_in_swap (const struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_ANON
+		&& (page->anon.slot != SLOT_NONE || page->anon.zentry != NULL);
+}
+
+/* Reads the copy of PAGE in swap into KVA, leaving PAGE as it is.
+ * PAGE must be out of memory, so that its copy is current. */
+void
+anon_read_swap (const struct page *page, void *kva) {
+	ASSERT (anon_in_swap (page));
+	ASSERT (page->frame == NULL);
+
+	if (!zswap_copy (page, kva))
+		slot_read (page->anon.slot, kva);
+}
+
+/* Takes CNT consecutive free slots and returns the first, or
+ * SLOT_NONE if there is no such run.  A run of more than one slot
+ * starts on a SWAP_CLUSTER boundary if it can, so that read-ahead
+ * finds it in one cluster. */
+static size_t
+slot_alloc (size_t cnt) {
+	size_t slot_cnt = bitmap_size (swap_slots);
+	size_t slot = SLOT_NONE;
+	size_t start;
+
+	lock_acquire (&swap_lock);
+	if (cnt > 1)
+		for (start = 0; start + cnt <= slot_cnt; start += SWAP_CLUSTER)
+			if (bitmap_none (swap_slots, start, cnt)) {
+				bitmap_set_multiple (swap_slots, start, cnt, true);
+				slot = start;
+				break;
+			}
+	if (slot == SLOT_NONE)
+		slot = bitmap_scan_and_flip (swap_slots, 0, cnt, false);
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Records that SLOT holds PAGE, which OWNER maps. */
+static void
+slot_set_owner (size_t slot, struct page *page, struct thread *owner) {
+	lock_acquire (&swap_lock);
+	slot_owners[slot] = (struct slot_owner) { page, owner };
+	lock_release (&swap_lock);
+}
+
+/* Gives SLOT back. */
+static void
+slot_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_slots, slot));
+	bitmap_reset (swap_slots, slot);
+	slot_owners[slot] = (struct slot_owner) { NULL, NULL };
+	lock_release (&swap_lock);
+}
+
+/* Writes the page at KVA to SLOT. */
+static void
+slot_write (size_t slot, const void *kva) {
+	size_t i;
+
+	for (i = 0; i < SLOT_SECTORS; i++)
+		disk_write (swap_disk, slot * SLOT_SECTORS + i,
+				(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Reads SLOT into the page at KVA. */
+static void
+slot_read (size_t slot, void *kva) {
+	size_t i;
+
+	for (i = 0; i < SLOT_SECTORS; i++)
+		disk_read (swap_disk, slot * SLOT_SECTORS + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
 }
@@ -1,6 +1,10 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <round.h>
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+#include "vm/vma.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -24,35 +28,80 @@ bool
 file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	/* Set up the handler */
 	page->operations = &file_ops;
-
-	struct file_page *file_page = &page->file;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	return vma_load_page (page->vma, page->va, kva);
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_backed_clean (page);
+	return true;
+}
+
+/* Writes PAGE back to its part of the file, if it is in memory
+ * and has been written to.  The caller must have pinned its
+ * frame.  The dirty bit is cleared before the write, so that a
+ * store that races with the write leaves the page dirty again. */
+void
+file_backed_clean (struct page *page) {
+	const struct vma *vma = page->vma;
+	size_t ofs = (uint8_t *) page->va - vma->start;
+	size_t write_bytes;
+	uint64_t *pml4;
+
+	if (page->frame == NULL || ofs >= vma->read_bytes)
+		return;
+	pml4 = page->frame->owner->pml4;
+	if (!pml4_is_dirty (pml4, page->va))
+		return;
+	pml4_set_dirty (pml4, page->va, false);
+
+	write_bytes = vma->read_bytes - ofs;
+	if (write_bytes > PGSIZE)
+		write_bytes = PGSIZE;
+	file_write_at (vma->file, page->frame->kva, write_bytes,
+			vma->offset + ofs);
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_backed_clean (page);
+	vm_release_frame (page);
 }
 
-/* Do the mmap */
+/* Do the mmap.
+ * Maps LENGTH bytes of FILE, from OFFSET, as one area at ADDR, so
+ * that nothing is read or allocated until a page is touched. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	off_t file_len = file_length (file);
+	size_t read_bytes;
+
+	if (offset >= file_len)
+		return NULL;
+	read_bytes = (size_t) (file_len - offset) < length
+		? (size_t) (file_len - offset) : length;
+	if (!vm_alloc_area (VM_FILE, addr, DIV_ROUND_UP (length, PGSIZE),
+				writable, file, offset, read_bytes))
+		return NULL;
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma = vma_find (spt, addr);
+
+	if (vma != NULL && vma->start == addr
+			&& VM_TYPE (vma->type) == VM_FILE)
+		spt_remove_area (spt, vma);
 }
@@ -3,3 +3,5 @@ vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
 vm_SRC += vm/inspect.c    # Testing utility
+vm_SRC += vm/vma.c        # Virtual memory areas
+vm_SRC += vm/zswap.c      # Compressed swap cache
@@ -1,8 +1,44 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <intrinsic.h>
+#include <list.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/vma.h"
+#include "vm/zswap.h"
+
+struct kmem_cache *page_cache;
+struct kmem_cache *frame_cache;
+
+/* Frame table.
+ * Every frame that holds a user page is on FRAMES, in the order
+ * the CLOCK hand sweeps them, whichever process it belongs to.
+ * Dirty frames the hand passed over wait on LAUNDRY for the
+ * cleaner thread.  FRAME_LOCK guards both lists, the hand, and
+ * the PINNED and LAUNDRY members of every frame; FRAME_COND is
+ * signaled whenever a frame is unpinned or evicted. */
+static struct list frames;
+static struct list laundry;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+static struct condition frame_cond;
+static struct semaphore cleaner_sema;
+
+/* Frame of zeros that every untouched anonymous page is mapped
+ * to, read-only, until it is first written.  A page mapped there
+ * has a struct page but no frame of its own. */
+static void *zero_page;
+
+/* Write-protect: supervisor writes honor read-only PTEs too. */
+#define CR0_WP (1 << 16)
+
+static void vm_cleaner (void *aux);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -16,6 +52,26 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+	frame_cache = kmem_cache_create ("frame", sizeof (struct frame), NULL);
+	if (page_cache == NULL || frame_cache == NULL)
+		PANIC ("vm_init: out of memory");
+	vma_init ();
+
+	list_init (&frames);
+	list_init (&laundry);
+	lock_init (&frame_lock);
+	cond_init (&frame_cond);
+	sema_init (&cleaner_sema, 0);
+	if (thread_create ("vm_cleaner", PRI_DEFAULT, vm_cleaner, NULL)
+			== TID_ERROR)
+		PANIC ("vm_init: cannot start the cleaner");
+
+	/* System calls write user buffers through user addresses, and
+	 * must fault on the zero page like the process itself would,
+	 * not write through it. */
+	zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	lcr0 (rcr0 () | CR0_WP);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,10 +92,21 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool vm_map_frame (struct page *page, struct frame *frame);
+static struct frame *vm_new_frame (void *kva);
+static bool vm_page_in (struct page *page);
+static struct frame *vm_pin_frame (struct page *page);
+static void vm_unpin_frame (struct frame *frame);
+static struct page *vm_page_create (struct supplemental_page_table *,
+		struct vma *, void *va);
+static bool vm_page_load (struct page *page, void *aux);
+static bool is_stack_access (const void *va, uintptr_t rsp);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
- * `vm_alloc_page`. */
+ * `vm_alloc_page`.
+ * This makes a one-page area; no struct page exists until the
+ * page is touched. */
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
@@ -47,96 +114,607 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma = vma_create (spt, upage, 1, type, writable);
 
-	/* Check wheter the upage is already occupied or not. */
-	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+	if (vma == NULL)
+		return false;
+	vma->init = init;
+	vma->aux = aux;
+	return true;
+}
 
-		/* TODO: Insert the page into the spt. */
+/* Adds an area of PAGE_CNT pages at UPAGE, with pages of TYPE, to
+ * the current process.  The first READ_BYTES bytes of the area
+ * are read from FILE, starting at offset OFS, when their pages are
+ * touched, and the rest are zeros.  FILE may be null if READ_BYTES
+ * is 0; otherwise the area keeps its own handle to it.
+ * Returns false if the range is taken or memory runs out. */
+bool
+vm_alloc_area (enum vm_type type, void *upage, size_t page_cnt,
+		bool writable, struct file *file, off_t ofs, size_t read_bytes) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+
+	ASSERT (VM_TYPE (type) != VM_UNINIT);
+	ASSERT (read_bytes <= page_cnt * PGSIZE);
+	ASSERT (file != NULL || read_bytes == 0);
+
+	vma = vma_create (spt, upage, page_cnt, type, writable);
+	if (vma == NULL)
+		return false;
+	if (file != NULL) {
+		vma->file = file_reopen (file);
+		if (vma->file == NULL) {
+			vma_destroy (spt, vma);
+			return false;
+		}
 	}
-err:
-	return false;
+	vma->offset = ofs;
+	vma->read_bytes = read_bytes;
+	return true;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
-struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+/* Orders pages by address. */
+static bool
+page_less (const struct rb_node *a_, const struct rb_node *b_,
+		void *aux UNUSED) {
+	const struct page *a = rb_entry (a_, struct page, node);
+	const struct page *b = rb_entry (b_, struct page, node);
 
-	return page;
+	return a->va < b->va;
+}
+
+/* Find VA from spt and return page. On error, return NULL.
+ * Only pages that have been touched are found; see vma_find()
+ * for the area that holds VA. */
+struct page *
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key = { .va = pg_round_down (va) };
+	struct rb_node *n = rb_floor (&spt->pages, &key.node);
+	struct page *page;
+
+	if (n == NULL)
+		return NULL;
+	page = rb_entry (n, struct page, node);
+	return page->va == key.va ? page : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	if (spt_find_page (spt, page->va) != NULL)
+		return false;
+	rb_insert (&spt->pages, &page->node);
+	return true;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	rb_remove (&spt->pages, &page->node);
+
+	/* Keep the frame out of the CLOCK hand's and the cleaner's
+	 * reach while the page is destroyed.  A page without one may
+	 * still map the zero page, which pml4_destroy() must not free. */
+	if (vm_pin_frame (page) == NULL)
+		pml4_clear_page (thread_current ()->pml4, page->va);
 	vm_dealloc_page (page);
-	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes VMA and all of its pages from SPT. */
+void
+spt_remove_area (struct supplemental_page_table *spt, struct vma *vma) {
+	struct page key = { .va = vma->start };
+	struct rb_node *n = rb_floor (&spt->pages, &key.node);
+
+	/* The floor of START is either the first page of VMA or a page
+	 * below it; step over the latter. */
+	if (n == NULL)
+		n = rb_first (&spt->pages);
+	else if (rb_entry (n, struct page, node)->va < (void *) vma->start)
+		n = rb_next (n);
+
+	while (n != NULL) {
+		struct page *page = rb_entry (n, struct page, node);
+
+		if (page->va >= (void *) vma->end)
+			break;
+		n = rb_next (n);
+		spt_remove_page (spt, page);
+	}
+	vma_destroy (spt, vma);
+}
+
+/* Returns true if VA may be accessed by the current process: it
+ * is a user address in one of its areas, or one that a stack
+ * access would grow the stack to cover. */
+bool
+vm_addr_is_valid (const void *va) {
+	struct thread *t = thread_current ();
+
+	if (va == NULL || !is_user_vaddr (va))
+		return false;
+	return vma_find (&t->spt, va) != NULL
+		|| is_stack_access (va, t->user_rsp);
+}
+
+/* Returns true if VA may be written by the current process: it
+ * is valid, as for vm_addr_is_valid(), and its area is writable.
+ * The stack only ever grows writable pages. */
+bool
+vm_addr_is_writable (const void *va) {
+	struct thread *t = thread_current ();
+	struct vma *vma;
+
+	if (va == NULL || !is_user_vaddr (va))
+		return false;
+	vma = vma_find (&t->spt, va);
+	if (vma != NULL)
+		return vma->writable;
+	return is_stack_access (va, t->user_rsp);
+}
+
+/* Sweeps the CLOCK hand one frame forward and returns the frame
+ * it passed.  Called with FRAME_LOCK held. */
+static struct frame *
+clock_advance (void) {
+	struct frame *frame;
+
+	if (clock_hand == NULL || clock_hand == list_end (&frames))
+		clock_hand = list_begin (&frames);
+	frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Get the struct frame, that will be evicted.
+ * Runs the CLOCK hand over the frame table.  A frame accessed
+ * since the hand last passed it gets a second chance.  A dirty
+ * one is put on the laundry for the cleaner thread instead of
+ * being written back here, and only if sweeps over the whole
+ * table find nothing clean is a dirty frame taken.  With the
+ * compressed cache on, a dirty anonymous frame costs no disk write
+ * to evict, so it is taken like a clean one.  The victim comes back
+ * pinned, or a null pointer if every frame is pinned.  Called with
+ * FRAME_LOCK held. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	struct frame *dirty = NULL;
+	size_t budget = 3 * list_size (&frames);
+	bool washing = false;
+
+	while (budget-- > 0) {
+		struct frame *frame = clock_advance ();
+		uint64_t *pml4;
+		void *va;
+
+		if (frame->pinned)
+			continue;
+		pml4 = frame->owner->pml4;
+		va = frame->page->va;
+		if (pml4_is_accessed (pml4, va)) {
+			pml4_set_accessed (pml4, va, false);
+			continue;
+		}
+		if (pml4_is_dirty (pml4, va)
+				&& !(zswap_enabled ()
+					&& VM_TYPE (frame->page->operations->type) == VM_ANON)) {
+			if (!frame->laundry) {
+				frame->laundry = true;
+				list_push_back (&laundry, &frame->laundry_elem);
+				washing = true;
+			}
+			if (dirty == NULL)
+				dirty = frame;
+			continue;
+		}
+		victim = frame;
+		break;
+	}
+	if (washing)
+		sema_up (&cleaner_sema);
 
+	if (victim == NULL)
+		victim = dirty;
+	if (victim != NULL)
+		victim->pinned = true;
 	return victim;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ * The frame comes back pinned, owned by the current thread, with
+ * no page in it. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	size_t tries;
+
+	for (tries = 0; ; tries++) {
+		struct frame *victim;
+		struct page *page;
+		uint64_t *pml4;
+		bool dirty;
+
+		lock_acquire (&frame_lock);
+		victim = tries <= list_size (&frames) ? vm_get_victim () : NULL;
+		lock_release (&frame_lock);
+		if (victim == NULL)
+			return NULL;
+
+		/* Unmap the page first, so that its owner cannot change it
+		 * while it is being written out. */
+		page = victim->page;
+		pml4 = victim->owner->pml4;
+		dirty = pml4_is_dirty (pml4, page->va);
+		pml4_clear_page (pml4, page->va);
+
+		if (swap_out (page)) {
+			lock_acquire (&frame_lock);
+			page->frame = NULL;
+			victim->page = NULL;
+			victim->owner = thread_current ();
+			if (victim->laundry) {
+				list_remove (&victim->laundry_elem);
+				victim->laundry = false;
+			}
+			cond_broadcast (&frame_cond, &frame_lock);
+			lock_release (&frame_lock);
+			return victim;
+		}
+
+		/* The page cannot leave memory now.  Map it again, as it
+		 * was, and look for another. */
+		pml4_set_page (pml4, page->va, victim->kva, page->writable);
+		pml4_set_dirty (pml4, page->va, dirty);
+		vm_unpin_frame (victim);
+	}
+}
+
+/* Takes a clean frame that the CLOCK hand would evict away from
+ * its page and returns its kernel virtual address, as a user page
+ * the caller now owns, or a null pointer if the hand finds none.
+ * Unlike vm_evict_frame(), this never writes a page out, so the
+ * compressed cache can grow with it while storing a page. */
+void *
+vm_reclaim_clean_frame (void) {
+	struct frame *victim = NULL;
+	size_t budget;
+	struct page *page;
+	uint64_t *pml4;
+	void *kva;
+
+	lock_acquire (&frame_lock);
+	for (budget = 2 * list_size (&frames); budget > 0; budget--) {
+		struct frame *frame = clock_advance ();
+
+		if (frame->pinned)
+			continue;
+		pml4 = frame->owner->pml4;
+		if (pml4_is_accessed (pml4, frame->page->va)) {
+			pml4_set_accessed (pml4, frame->page->va, false);
+			continue;
+		}
+		if (!pml4_is_dirty (pml4, frame->page->va)) {
+			victim = frame;
+			victim->pinned = true;
+			break;
+		}
+	}
+	lock_release (&frame_lock);
+	if (victim == NULL)
+		return NULL;
+
+	/* The owner may have written the page before it was unmapped;
+	 * then it is no longer clean, so leave it be. */
+	page = victim->page;
+	pml4 = victim->owner->pml4;
+	pml4_clear_page (pml4, page->va);
+	if (pml4_is_dirty (pml4, page->va) || !swap_out (page)) {
+		pml4_set_page (pml4, page->va, victim->kva, page->writable);
+		pml4_set_dirty (pml4, page->va, true);
+		vm_unpin_frame (victim);
+		return NULL;
+	}
 
-	return NULL;
+	lock_acquire (&frame_lock);
+	page->frame = NULL;
+	if (clock_hand == &victim->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&victim->elem);
+	if (victim->laundry)
+		list_remove (&victim->laundry_elem);
+	cond_broadcast (&frame_cond, &frame_lock);
+	lock_release (&frame_lock);
+
+	kva = victim->kva;
+	kmem_cache_free (frame_cache, victim);
+	return kva;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is in the frame table, pinned until its page has been
+ * filled, so that the CLOCK hand passes over it. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
+	struct frame *frame;
+
+	if (kva == NULL) {
+		frame = vm_evict_frame ();
+		if (frame == NULL)
+			PANIC ("vm_get_frame: out of user pages");
+	} else
+		frame = vm_new_frame (kva);
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Adds a frame for the free user page KVA to the frame table,
+ * pinned and owned by the current thread, and returns it. */
+static struct frame *
+vm_new_frame (void *kva) {
+	struct frame *frame = kmem_cache_alloc (frame_cache);
+
+	if (frame == NULL)
+		PANIC ("vm_new_frame: out of memory");
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->owner = thread_current ();
+	frame->pinned = true;
+	frame->laundry = false;
+
+	lock_acquire (&frame_lock);
+	list_push_back (&frames, &frame->elem);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Removes FRAME, which must be pinned, from the frame table and
+ * frees it. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_free_frame (struct frame *frame) {
+	ASSERT (frame->pinned);
+
+	lock_acquire (&frame_lock);
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+	if (frame->laundry)
+		list_remove (&frame->laundry_elem);
+	lock_release (&frame_lock);
+
+	palloc_free_page (frame->kva);
+	kmem_cache_free (frame_cache, frame);
 }
 
-/* Handle the fault on write_protected page */
+/* Waits until nobody else has PAGE's frame pinned, then pins it
+ * for the caller.  Returns the frame, or a null pointer if the
+ * page turned out to have been evicted. */
+static struct frame *
+vm_pin_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_cond, &frame_lock);
+	frame = page->frame;
+	if (frame != NULL)
+		frame->pinned = true;
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Lets FRAME be evicted or cleaned again. */
+static void
+vm_unpin_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	cond_broadcast (&frame_cond, &frame_lock);
+	lock_release (&frame_lock);
+}
+
+/* Unmaps PAGE and frees its frame, if it has one.  The caller must
+ * have pinned the frame. */
+void
+vm_release_frame (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (frame == NULL)
+		return;
+	pml4_clear_page (frame->owner->pml4, page->va);
+	page->frame = NULL;
+	vm_free_frame (frame);
+}
+
+/* Locks the frame table for palloc's compaction, which moves user
+ * pages to other frames; see compact_pool().  Returns false, and
+ * locks nothing, if the caller already holds it. */
+bool
+vm_migrate_begin (void) {
+	if (lock_held_by_current_thread (&frame_lock))
+		return false;
+	lock_acquire (&frame_lock);
+	return true;
+}
+
+/* Moves the frames among the CNT user pages at WINDOW: page I of
+ * the window goes to DST[I], if that is not null.  Returns false,
+ * and changes nothing, unless every page that moves is a frame in
+ * the frame table and none of those is pinned, since the holder of
+ * a pinned frame may be using its old kernel address.  Must be
+ * called between vm_migrate_begin() and vm_migrate_end(), with
+ * interrupts off. */
+bool
+vm_migrate_frames (const void *window, size_t cnt, void *const dst[]) {
+	const uint8_t *start = window;
+	const uint8_t *end = start + cnt * PGSIZE;
+	size_t moving = 0, found = 0;
+	struct list_elem *e;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (i = 0; i < cnt; i++)
+		if (dst[i] != NULL)
+			moving++;
+	for (e = list_begin (&frames); e != list_end (&frames); e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+		const uint8_t *kva = frame->kva;
+
+		if (kva < start || kva >= end)
+			continue;
+		if (frame->pinned || dst[(kva - start) / PGSIZE] == NULL)
+			return false;
+		found++;
+	}
+	if (found != moving)
+		return false;
+
+	for (e = list_begin (&frames); e != list_end (&frames); e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+		const uint8_t *kva = frame->kva;
+
+		if (kva >= start && kva < end)
+			frame->kva = dst[(kva - start) / PGSIZE];
+	}
+	return true;
+}
+
+/* Unlocks the frame table after vm_migrate_begin(). */
+void
+vm_migrate_end (void) {
+	lock_release (&frame_lock);
+}
+
+/* Cleaner thread.
+ * Writes dirty frames that the CLOCK hand put on the laundry back
+ * to where they came from, while they are still mapped, so that
+ * the hand finds them clean next time around and eviction does
+ * not wait on the write.  Anonymous pages go to swap SWAP_CLUSTER
+ * at a time, in one burst of consecutive slots. */
+static void
+vm_cleaner (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&cleaner_sema);
+		for (;;) {
+			struct frame *batch[SWAP_CLUSTER];
+			struct page *anon[SWAP_CLUSTER];
+			size_t cnt = 0, anon_cnt = 0;
+			size_t i;
+
+			lock_acquire (&frame_lock);
+			while (cnt < SWAP_CLUSTER && !list_empty (&laundry)) {
+				struct frame *frame = list_entry (list_pop_front (&laundry),
+						struct frame, laundry_elem);
+
+				frame->laundry = false;
+				if (!frame->pinned) {
+					frame->pinned = true;
+					batch[cnt++] = frame;
+				}
+			}
+			lock_release (&frame_lock);
+			if (cnt == 0)
+				break;
+
+			for (i = 0; i < cnt; i++) {
+				struct page *page = batch[i]->page;
+
+				if (VM_TYPE (page->operations->type) == VM_FILE)
+					file_backed_clean (page);
+				else
+					anon[anon_cnt++] = page;
+			}
+			if (anon_cnt > 0)
+				anon_clean (anon, anon_cnt);
+			for (i = 0; i < cnt; i++)
+				vm_unpin_frame (batch[i]);
+		}
+	}
+}
+
+/* Returns true if an access to VA, with the user stack pointer at
+ * RSP, should grow the stack: VA must be within STACK_MAX of the
+ * top of the stack, and no more than 8 bytes below RSP, which is
+ * as far as PUSH reaches before it moves RSP. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+is_stack_access (const void *va, uintptr_t rsp) {
+	uintptr_t addr = (uintptr_t) va;
+
+	return addr < USER_STACK && addr >= USER_STACK - STACK_MAX
+		&& addr + 8 >= rsp;
+}
+
+/* Growing the stack. */
+static bool
+vm_stack_growth (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *stack = vma_find (spt, (uint8_t *) USER_STACK - PGSIZE);
+
+	if (stack == NULL || !(stack->type & VM_STACK))
+		return false;
+	return vma_extend_down (spt, stack, pg_round_down (addr));
+}
+
+/* Handle the fault on write_protected page.
+ * The only such pages that may be written are those that share
+ * the zero page; the first write gives one a frame of its own. */
+static bool
+vm_handle_wp (struct page *page) {
+	if (!page->writable || page->frame != NULL
+			|| pml4_get_page (thread_current ()->pml4, page->va) != zero_page)
+		return false;
+	return vm_do_claim_page (page);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	struct page *page;
+	struct vma *vma;
+
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (!not_present)
+		return page != NULL && vm_handle_wp (page);
+	if (page != NULL) {
+		if (!vm_page_in (page))
+			return false;
+		anon_readahead (page);
+		return true;
+	}
 
+	/* First touch: make the page from its area, growing the stack
+	 * first if that is what the access asks for. */
+	vma = vma_find (spt, addr);
+	if (vma == NULL) {
+		uintptr_t rsp = user ? f->rsp : t->user_rsp;
+
+		if (!is_stack_access (addr, rsp) || !vm_stack_growth (addr))
+			return false;
+		vma = vma_find (spt, addr);
+	}
+	if (write && !vma->writable)
+		return false;
+
+	/* Reading a page that starts out as zeros needs no frame until
+	 * it is written. */
+	page = vm_page_create (spt, vma, addr);
+	if (page == NULL)
+		return false;
+	if (!write && vma_page_is_zero (vma, page->va))
+		return pml4_set_page (t->pml4, page->va, zero_page, false);
 	return vm_do_claim_page (page);
 }
 
@@ -150,41 +728,188 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = spt_find_page (spt, va);
 
-	return vm_do_claim_page (page);
+	if (page == NULL) {
+		struct vma *vma = vma_find (spt, va);
+
+		if (vma == NULL)
+			return false;
+		page = vm_page_create (spt, vma, va);
+		if (page == NULL)
+			return false;
+	}
+	return vm_page_in (page);
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Brings PAGE into memory, unless it is there already.  If the
+ * page is being evicted, waits for that to finish first. */
 static bool
-vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+vm_page_in (struct page *page) {
+	struct frame *frame = vm_pin_frame (page);
 
+	if (frame != NULL) {
+		vm_unpin_frame (frame);
+		return true;
+	}
+	return vm_do_claim_page (page);
+}
+
+/* Puts PAGE in FRAME, which must be pinned, and maps it, without
+ * filling it. */
+static bool
+vm_map_frame (struct page *page, struct frame *frame) {
 	/* Set links */
 	frame->page = page;
 	page->frame = frame;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	if (!pml4_set_page (frame->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		page->frame = NULL;
+		vm_free_frame (frame);
+		return false;
+	}
+	return true;
+}
 
-	return swap_in (page, frame->kva);
+/* Brings PAGE, a page of the current thread that is not in
+ * memory, in ahead of need, if a user page is free right now; it
+ * never evicts anything.  The page starts out with its accessed
+ * bit clear, so it is the first to go if nothing touches it.
+ * Returns false if no page was free. */
+bool
+vm_prefetch_page (struct page *page) {
+	void *kva = palloc_get_page (PAL_USER);
+	bool success;
+
+	ASSERT (page->frame == NULL);
+
+	if (kva == NULL)
+		return false;
+	if (!vm_map_frame (page, vm_new_frame (kva)))
+		return false;
+	success = swap_in (page, page->frame->kva);
+	vm_unpin_frame (page->frame);
+	return success;
+}
+
+/* Claim the PAGE and set up the mmu. */
+static bool
+vm_do_claim_page (struct page *page) {
+	bool success;
+
+	/* PAGE may share the zero page.  pml4_set_page() does not
+	 * flush the TLB, so take that mapping down first. */
+	pml4_clear_page (thread_current ()->pml4, page->va);
+	if (!vm_map_frame (page, vm_get_frame ()))
+		return false;
+	success = swap_in (page, page->frame->kva);
+	vm_unpin_frame (page->frame);
+	return success;
+}
+
+/* Makes the struct page for page VA of VMA, as an uninit page that
+ * vm_page_load() fills on its first swap_in, and adds it to SPT.
+ * Returns a null pointer if memory runs out. */
+static struct page *
+vm_page_create (struct supplemental_page_table *spt, struct vma *vma,
+		void *va) {
+	struct page *page = kmem_cache_alloc (page_cache);
+
+	if (page == NULL)
+		return NULL;
+	uninit_new (page, pg_round_down (va), vm_page_load, vma->type, vma,
+			VM_TYPE (vma->type) == VM_FILE
+				? file_backed_initializer : anon_initializer);
+	page->vma = vma;
+	page->writable = vma->writable;
+	if (!spt_insert_page (spt, page)) {
+		kmem_cache_free (page_cache, page);
+		return NULL;
+	}
+	return page;
+}
+
+/* Fills PAGE from its area AUX, then runs the area's initializer,
+ * if it has one. */
+static bool
+vm_page_load (struct page *page, void *aux) {
+	struct vma *vma = aux;
+
+	if (!vma_load_page (vma, page->va, page->frame->kva))
+		return false;
+	return vma->init == NULL || vma->init (page, vma->aux);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	rb_init (&spt->vmas, vma_less, NULL);
+	rb_init (&spt->pages, page_less, NULL);
+	spt->last_vma = NULL;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.
+ * Each area is copied as a whole; only pages that SRC has in
+ * memory are copied, and the rest stay untouched in DST too. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct rb_node *n;
+
+	for (n = rb_first (&src->vmas); n != NULL; n = rb_next (n))
+		if (vma_clone (dst, rb_entry (n, struct vma, node)) == NULL)
+			return false;
+
+	for (n = rb_first (&src->pages); n != NULL; n = rb_next (n)) {
+		struct page *src_page = rb_entry (n, struct page, node);
+		struct frame *src_frame;
+		struct page *page;
+		bool success, dirty;
+
+		/* A page that SRC has neither in memory nor in swap is no
+		 * different from its area's contents, so DST loads it like
+		 * any other untouched page. */
+		src_frame = vm_pin_frame (src_page);
+		if (src_frame == NULL && !anon_in_swap (src_page))
+			continue;
+		page = vm_page_create (dst, vma_find (dst, src_page->va),
+				src_page->va);
+		if (page == NULL || !vm_map_frame (page, vm_get_frame ())) {
+			if (src_frame != NULL)
+				vm_unpin_frame (src_frame);
+			return false;
+		}
+
+		/* Take SRC's contents instead of loading the page, but
+		 * still turn it into a page of its area's type.  DST's
+		 * copy of an anonymous page matches neither its area nor
+		 * any slot, so it starts out dirty. */
+		if (src_frame != NULL) {
+			memcpy (page->frame->kva, src_frame->kva, PGSIZE);
+			dirty = pml4_is_dirty (src_frame->owner->pml4, src_page->va);
+			vm_unpin_frame (src_frame);
+		} else {
+			anon_read_swap (src_page, page->frame->kva);
+			dirty = true;
+		}
+		success = page->uninit.page_initializer (page, page->uninit.type,
+				page->frame->kva);
+		pml4_set_dirty (page->frame->owner->pml4, page->va,
+				dirty || page_get_type (page) == VM_ANON);
+		vm_unpin_frame (page->frame);
+		if (!success)
+			return false;
+	}
+	return true;
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	while (!rb_empty (&spt->vmas))
+		spt_remove_area (spt,
+				rb_entry (rb_first (&spt->vmas), struct vma, node));
 }
@@ -0,0 +1,187 @@
+/* vma.c: Virtual memory areas of the supplemental page table.
+ *
+ * The areas of a process are kept in a red-black tree ordered by
+ * start address.  They never overlap, so the area that contains an
+ * address is the last one that starts at or below it, which
+ * rb_floor() finds in O(log n).  The area found last is cached,
+ * since faults tend to come in runs on the same area. */
+
+#include "vm/vma.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+static struct kmem_cache *vma_cache;
+
+/* Creates the object cache for areas. */
+void
+vma_init (void) {
+	vma_cache = kmem_cache_create ("vma", sizeof (struct vma), NULL);
+	if (vma_cache == NULL)
+		PANIC ("vma_init: out of memory");
+}
+
+/* Orders areas by start address. */
+bool
+vma_less (const struct rb_node *a_, const struct rb_node *b_,
+		void *aux UNUSED) {
+	const struct vma *a = rb_entry (a_, struct vma, node);
+	const struct vma *b = rb_entry (b_, struct vma, node);
+
+	return a->start < b->start;
+}
+
+/* Adds an area of PAGE_CNT pages at START, with pages of TYPE, to
+ * SPT and returns it, with no backing file and no initializer.
+ * Returns a null pointer if the range is not in user space,
+ * overlaps another area, or memory runs out. */
+struct vma *
+vma_create (struct supplemental_page_table *spt, void *start,
+		size_t page_cnt, enum vm_type type, bool writable) {
+	struct vma *vma;
+
+	ASSERT (pg_ofs (start) == 0);
+
+	if (page_cnt == 0 || !vma_is_free (spt, start, page_cnt))
+		return NULL;
+
+	vma = kmem_cache_alloc (vma_cache);
+	if (vma == NULL)
+		return NULL;
+	*vma = (struct vma) {
+		.start = start,
+		.end = (uint8_t *) start + PGSIZE * page_cnt,
+		.type = type,
+		.writable = writable,
+	};
+	rb_insert (&spt->vmas, &vma->node);
+	return vma;
+}
+
+/* Adds a copy of SRC, an area of another process, to SPT, and
+ * returns it, or a null pointer if memory runs out. */
+struct vma *
+vma_clone (struct supplemental_page_table *spt, const struct vma *src) {
+	struct vma *vma = vma_create (spt, src->start,
+			(src->end - src->start) / PGSIZE, src->type, src->writable);
+
+	if (vma == NULL)
+		return NULL;
+	if (src->file != NULL) {
+		vma->file = file_reopen (src->file);
+		if (vma->file == NULL) {
+			vma_destroy (spt, vma);
+			return NULL;
+		}
+	}
+	vma->offset = src->offset;
+	vma->read_bytes = src->read_bytes;
+	vma->init = src->init;
+	vma->aux = src->aux;
+	return vma;
+}
+
+/* Removes VMA from SPT and frees it.  Its pages must be gone. */
+void
+vma_destroy (struct supplemental_page_table *spt, struct vma *vma) {
+	if (spt->last_vma == vma)
+		spt->last_vma = NULL;
+	rb_remove (&spt->vmas, &vma->node);
+	if (vma->file != NULL)
+		file_close (vma->file);
+	kmem_cache_free (vma_cache, vma);
+}
+
+/* Returns the area of SPT that contains VA, or a null pointer if
+ * there is none. */
+struct vma *
+vma_find (struct supplemental_page_table *spt, const void *va) {
+	struct vma key = { .start = (uint8_t *) va };
+	struct rb_node *n;
+	struct vma *vma = spt->last_vma;
+
+	if (vma != NULL && vma->start <= (uint8_t *) va
+			&& (uint8_t *) va < vma->end)
+		return vma;
+
+	n = rb_floor (&spt->vmas, &key.node);
+	if (n == NULL)
+		return NULL;
+	vma = rb_entry (n, struct vma, node);
+	if ((uint8_t *) va >= vma->end)
+		return NULL;
+	spt->last_vma = vma;
+	return vma;
+}
+
+/* Returns true if the PAGE_CNT pages at START are in user space
+ * and in no area of SPT. */
+bool
+vma_is_free (struct supplemental_page_table *spt, const void *start,
+		size_t page_cnt) {
+	const uint8_t *end = (const uint8_t *) start + PGSIZE * page_cnt;
+	struct vma key = { .start = (uint8_t *) end - 1 };
+	struct rb_node *n;
+
+	if (start == NULL || end <= (const uint8_t *) start
+			|| !is_user_vaddr (end - 1))
+		return false;
+
+	/* The last area that starts before END must end by START. */
+	n = rb_floor (&spt->vmas, &key.node);
+	return n == NULL
+		|| rb_entry (n, struct vma, node)->end <= (const uint8_t *) start;
+}
+
+/* Moves the start of VMA down to START, which must be below it,
+ * so that the area grows downward like a stack.  Returns false if
+ * the pages in between are not free. */
+bool
+vma_extend_down (struct supplemental_page_table *spt, struct vma *vma,
+		void *start) {
+	ASSERT (pg_ofs (start) == 0);
+	ASSERT ((uint8_t *) start < vma->start);
+
+	if (!vma_is_free (spt, start,
+				(vma->start - (uint8_t *) start) / PGSIZE))
+		return false;
+
+	/* No area lies in between, so the order stays the same, but
+	 * the tree must not see a key change in place. */
+	rb_remove (&spt->vmas, &vma->node);
+	vma->start = start;
+	rb_insert (&spt->vmas, &vma->node);
+	return true;
+}
+
+/* Fills KVA with the contents that page VA of VMA starts out
+ * with: its part of the backing file, then zeros.  Returns false
+ * if the file could not be read. */
+bool
+vma_load_page (const struct vma *vma, const void *va, void *kva) {
+	size_t ofs = (const uint8_t *) va - vma->start;
+	size_t read_bytes = ofs < vma->read_bytes ? vma->read_bytes - ofs : 0;
+
+	if (read_bytes > PGSIZE)
+		read_bytes = PGSIZE;
+	if (read_bytes > 0
+			&& file_read_at (vma->file, kva, read_bytes, vma->offset + ofs)
+				!= (off_t) read_bytes)
+		return false;
+	memset ((uint8_t *) kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
+}
+
+/* Returns true if the page at VA in VMA starts out as all zeros:
+ * an anonymous page past the file's bytes that no initializer
+ * touches. */
+bool
+vma_page_is_zero (const struct vma *vma, const void *va) {
+	size_t ofs = (const uint8_t *) va - vma->start;
+
+	return VM_TYPE (vma->type) == VM_ANON && vma->init == NULL
+		&& ofs >= vma->read_bytes;
+}
@@ -0,0 +1,296 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+ *
+ * A dirty anonymous page on its way out of memory is compressed
+ * into a pool of user pages instead of being written to disk, so
+ * that a fault on it costs a decompression rather than a disk
+ * read.  Pages that do not shrink to ZSWAP_MAX_SIZE go to disk
+ * as before, and pages of all zeros take no pool space at all.
+ *
+ * The pool is a log: compressed pages are packed one after
+ * another into the pool page that is open, and a pool page is
+ * freed when the last page in it is gone.  It grows up to
+ * zswap_percent of the user pool, taking free user pages, or
+ * clean frames from the CLOCK hand when there are none.  When it
+ * cannot grow, the oldest compressed pages, which are the coldest
+ * and sit in the oldest pool pages, are written back to swap.
+ *
+ * ZSWAP_LOCK guards the pool, every entry, and the ZENTRY member
+ * of every anonymous page.  It is taken before the frame table's
+ * and the swap slots' locks. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Largest compressed page worth keeping. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* A compressed page. */
+struct zswap_entry {
+	struct list_elem elem;          /* In ENTRIES, unless all zeros. */
+	struct page *page;              /* Page whose contents these are. */
+	struct thread *owner;           /* Thread that maps PAGE. */
+	struct zpage *zpage;            /* Pool page holding DATA, or null. */
+	uint8_t *data;                  /* Compressed data. */
+	size_t size;                    /* Bytes of DATA; 0 for all zeros. */
+};
+
+/* Header of a pool page, followed by the data it holds. */
+struct zpage {
+	size_t used;                    /* Bytes handed out, header included. */
+	size_t live;                    /* # of entries with data here. */
+};
+
+unsigned zswap_percent = 20;
+
+static struct lock zswap_lock;
+static struct list entries;             /* Entries with data, oldest first. */
+static struct kmem_cache *entry_cache;
+static struct zpage *open_zpage;        /* Where data goes next. */
+static size_t zpage_cnt;                /* # of pool pages. */
+static size_t zpage_max;                /* Most pool pages. */
+
+/* Scratch space for compression and write-back. */
+static uint16_t lz_table[LZ_TABLE_SIZE];
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+static uint8_t page_buf[PGSIZE];
+
+static uint8_t *zpool_alloc (size_t size, struct zpage **);
+static void zpool_free (struct zpage *);
+static void entry_free (struct zswap_entry *);
+static bool entry_unpack (const struct zswap_entry *, void *kva);
+static bool writeback_oldest (void);
+
+/* Sizes the pool from zswap_percent. */
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+	list_init (&entries);
+	zpage_max = palloc_user_page_cnt () * zswap_percent / 100;
+	if (zpage_max == 0)
+		return;
+
+	entry_cache = kmem_cache_create ("zswap_entry",
+			sizeof (struct zswap_entry), NULL);
+	if (entry_cache == NULL)
+		PANIC ("zswap_init: out of memory");
+}
+
+/* Returns true if the cache is on. */
+bool
+zswap_enabled (void) {
+	return zpage_max > 0;
+}
+
+/* Returns true if the page at KVA is all zeros. */
+static bool
+is_zero_page (const void *kva) {
+	const uint64_t *p = kva;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Compresses the contents of PAGE, at KVA, into the cache, where
+ * a later zswap_load() finds them.  OWNER is the thread that maps
+ * PAGE.  Returns false, storing nothing, if the cache is off, the
+ * page does not compress well, or there is no room. */
+bool
+zswap_store (struct page *page, struct thread *owner, const void *kva) {
+	struct zswap_entry *e;
+	struct zpage *zp = NULL;
+	uint8_t *data = NULL;
+	size_t size = 0;
+
+	ASSERT (page->anon.zentry == NULL);
+
+	if (!zswap_enabled ())
+		return false;
+	e = kmem_cache_alloc (entry_cache);
+	if (e == NULL)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	if (!is_zero_page (kva)) {
+		size = lz_compress (kva, PGSIZE, zbuf, sizeof zbuf, lz_table);
+		if (size > 0)
+			data = zpool_alloc (size, &zp);
+		if (data == NULL) {
+			lock_release (&zswap_lock);
+			kmem_cache_free (entry_cache, e);
+			return false;
+		}
+		memcpy (data, zbuf, size);
+	}
+
+	*e = (struct zswap_entry) {
+		.page = page,
+		.owner = owner,
+		.zpage = zp,
+		.data = data,
+		.size = size,
+	};
+	if (data != NULL)
+		list_push_back (&entries, &e->elem);
+	page->anon.zentry = e;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* If the cache holds PAGE, decompresses it into KVA, drops it
+ * from the cache, and returns true.  Otherwise returns false. */
+bool
+zswap_load (struct page *page, void *kva) {
+	struct zswap_entry *e;
+	bool ok;
+
+	lock_acquire (&zswap_lock);
+	e = page->anon.zentry;
+	if (e == NULL) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+	ok = entry_unpack (e, kva);
+	entry_free (e);
+	lock_release (&zswap_lock);
+
+	if (!ok)
+		PANIC ("zswap: corrupt page at %p", page->va);
+	return true;
+}
+
+/* Like zswap_load(), but leaves PAGE in the cache. */
+bool
+zswap_copy (const struct page *page, void *kva) {
+	struct zswap_entry *e;
+	bool ok;
+
+	lock_acquire (&zswap_lock);
+	e = page->anon.zentry;
+	if (e == NULL) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+	ok = entry_unpack (e, kva);
+	lock_release (&zswap_lock);
+
+	if (!ok)
+		PANIC ("zswap: corrupt page at %p", page->va);
+	return true;
+}
+
+/* Drops PAGE from the cache, if it is there. */
+void
+zswap_invalidate (struct page *page) {
+	lock_acquire (&zswap_lock);
+	if (page->anon.zentry != NULL)
+		entry_free (page->anon.zentry);
+	lock_release (&zswap_lock);
+}
+
+/* Decompresses E into KVA.  Returns false if its data is corrupt. */
+static bool
+entry_unpack (const struct zswap_entry *e, void *kva) {
+	if (e->size == 0) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+	return lz_decompress (e->data, e->size, kva, PGSIZE) == PGSIZE;
+}
+
+/* Removes E from the cache and frees it and its data. */
+static void
+entry_free (struct zswap_entry *e) {
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+	e->page->anon.zentry = NULL;
+	if (e->zpage != NULL) {
+		list_remove (&e->elem);
+		zpool_free (e->zpage);
+	}
+	kmem_cache_free (entry_cache, e);
+}
+
+/* Writes the oldest entry back to its page's swap slot and drops
+ * it.  Returns false if there is none or swap is full. */
+static bool
+writeback_oldest (void) {
+	struct zswap_entry *e;
+
+	if (list_empty (&entries))
+		return false;
+	e = list_entry (list_front (&entries), struct zswap_entry, elem);
+	if (!entry_unpack (e, page_buf))
+		PANIC ("zswap: corrupt page at %p", e->page->va);
+	if (!anon_write_slot (e->page, e->owner, page_buf))
+		return false;
+	entry_free (e);
+	return true;
+}
+
+/* Takes SIZE bytes of pool space and returns them, with the pool
+ * page they are in in *ZP, or a null pointer if the pool is at
+ * its limit and nothing can be written back. */
+static uint8_t *
+zpool_alloc (size_t size, struct zpage **zp) {
+	ASSERT (size <= PGSIZE - sizeof (struct zpage));
+
+	for (;;) {
+		struct zpage *open = open_zpage;
+		void *kva;
+
+		if (open != NULL && open->used + size <= PGSIZE) {
+			uint8_t *data = (uint8_t *) open + open->used;
+
+			open->used += size;
+			open->live++;
+			*zp = open;
+			return data;
+		}
+
+		/* Start a new pool page. */
+		kva = NULL;
+		if (zpage_cnt < zpage_max) {
+			kva = palloc_get_page (PAL_USER);
+			if (kva == NULL)
+				kva = vm_reclaim_clean_frame ();
+		}
+		if (kva != NULL) {
+			open_zpage = kva;
+			open_zpage->used = sizeof *open_zpage;
+			open_zpage->live = 0;
+			zpage_cnt++;
+			if (open != NULL && open->live == 0) {
+				palloc_free_page (open);
+				zpage_cnt--;
+			}
+			continue;
+		}
+
+		if (!writeback_oldest ())
+			return NULL;
+	}
+}
+
+/* Notes that an entry with data in ZP is gone, and frees ZP if it
+ * was the last one. */
+static void
+zpool_free (struct zpage *zp) {
+	ASSERT (zp->live > 0);
+
+	if (--zp->live == 0 && zp != open_zpage) {
+		palloc_free_page (zp);
+		zpage_cnt--;
+	}
+}